@@ -0,0 +1,117 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <type_traits>
+#include "Vec2_generic.hpp"
+#include "Mat2_generic.hpp"
+#include "Kernels.hpp"
+
+namespace cge
+{
+    // Linear part followed by a translation: p' = linear * p + translation.
+    template<typename T>
+    struct Affine2_generic
+    {
+        Mat2_generic<T> linear;
+        Vec2_generic<T> translation;
+
+        constexpr Affine2_generic() {}
+        constexpr Affine2_generic(const Mat2_generic<T>& m, const Vec2_generic<T>& t = Vec2_generic<T>())
+            : linear(m), translation(t) {}
+
+        static constexpr Affine2_generic Translation(const Vec2_generic<T>& t)
+        {
+            return Affine2_generic(Mat2_generic<T>(), t);
+        }
+        static constexpr Affine2_generic Scaling(const Vec2_generic<T>& s)
+        {
+            return Affine2_generic(Mat2_generic<T>(s.x, 0, 0, s.y));
+        }
+        // Angle in radians, clockwise on screen as y points down.
+        static Affine2_generic Rotation(T angle)
+        {
+            return Affine2_generic(Rotate(Mat2_generic<T>(), angle));
+        }
+        static Affine2_generic Rotation(T angle, const Vec2_generic<T>& center)
+        {
+            return Translation(center) * Rotation(angle) * Translation(-center);
+        }
+
+        constexpr Vec2_generic<T> operator*(const Vec2_generic<T>& p) const
+        {
+            return linear * p + translation;
+        }
+        // rhs is applied first.
+        constexpr Affine2_generic operator*(const Affine2_generic& rhs) const
+        {
+            return Affine2_generic(linear * rhs.linear, linear * rhs.translation + translation);
+        }
+        constexpr Affine2_generic& operator*=(const Affine2_generic& rhs)
+        {
+            return *this = *this * rhs;
+        }
+        // { a, b, c, d, tx, ty } as the transform kernel takes it.
+        constexpr void Coefficients(T out[6]) const
+        {
+            for (int i = 0; i < 4; i++)
+                out[i] = linear[i];
+            out[4] = translation.x;
+            out[5] = translation.y;
+        }
+    };
+
+    /*
+        Points kept as one array of x and one of y coordinates, which lets a
+        transform work on several points per instruction.
+    */
+    template<typename T>
+    struct Points2_generic
+    {
+        std::vector<T> x, y;
+
+        size_t Size() const { return x.size(); }
+        void Resize(size_t n)
+        {
+            x.resize(n);
+            y.resize(n);
+        }
+        void Clear()
+        {
+            x.clear();
+            y.clear();
+        }
+        void Push(const Vec2_generic<T>& p)
+        {
+            x.push_back(p.x);
+            y.push_back(p.y);
+        }
+        Vec2_generic<T> operator[](size_t i) const { return Vec2_generic<T>(x[i], y[i]); }
+    };
+
+    /*
+        Transforms n points from xs, ys into outX, outY, which may be the inputs.
+        Floats go through the SIMD kernel, other types through a plain loop.
+    */
+    template<typename T>
+    void TransformPoints(const Affine2_generic<T>& m, const T* xs, const T* ys, T* outX, T* outY, size_t n)
+    {
+        T c[6];
+        m.Coefficients(c);
+        if constexpr (std::is_same<T, float>::value)
+            Kernels::Best().transform(c, xs, ys, outX, outY, n);
+        else
+            for (size_t i = 0; i < n; i++)
+            {
+                T x = xs[i], y = ys[i];
+                outX[i] = c[0] * x + c[1] * y + c[4];
+                outY[i] = c[2] * x + c[3] * y + c[5];
+            }
+    }
+    template<typename T>
+    void TransformPoints(const Affine2_generic<T>& m, const Points2_generic<T>& in, Points2_generic<T>& out)
+    {
+        out.Resize(in.Size());
+        TransformPoints(m, in.x.data(), in.y.data(), out.x.data(), out.y.data(), in.Size());
+    }
+}
@@ -0,0 +1,187 @@
+#pragma once
+#include <unistd.h>
+#include <poll.h>
+#include <cerrno>
+#include <cwchar>
+#include <vector>
+#include "OutputBackend.hpp"
+#include "Palette.hpp"
+#include "Quantize.hpp"
+
+namespace cge
+{
+    /*
+        Encodes every frame into one reusable byte buffer of VT escape sequences
+        and hands it to the terminal with a single write(). The cursor is only
+        moved where the written cells are not contiguous and colors are only set
+        when they differ from the previous cell. RGB cell colors are sent as they
+        are with true color and as the nearest of the 256 colors otherwise.
+    */
+    class AnsiBackend : public OutputBackend
+    {
+        int fd;
+        int originX, originY;  // window position on the terminal, 0-based
+        int termCols;
+        bool trueColor;
+        bool reducedColor = false;
+        std::vector<char> out;
+        size_t bytesLast = 0;
+        // What the terminal currently has, -1 and UNKNOWN when unknown.
+        static constexpr uint32_t UNKNOWN = UINT32_MAX;
+        int curRow = -1, curCol = -1;
+        uint32_t curF = UNKNOWN, curB = UNKNOWN;
+
+        void put(const char* s, size_t n) { out.insert(out.end(), s, s + n); }
+        void put(char c) { out.push_back(c); }
+        void put_uint(unsigned v)
+        {
+            char buf[10];
+            int n = 0;
+            do { buf[n++] = '0' + v % 10; v /= 10; } while (v);
+            while (n)
+                out.push_back(buf[--n]);
+        }
+        void put_utf8(wchar_t ch)
+        {
+            uint32_t c = (uint32_t)ch;
+            if (c < 0x80)
+                put((char)c);
+            else if (c < 0x800) {
+                put((char)(0xC0 | c >> 6));
+                put((char)(0x80 | (c & 0x3F)));
+            }
+            else if (c < 0x10000) {
+                put((char)(0xE0 | c >> 12));
+                put((char)(0x80 | (c >> 6 & 0x3F)));
+                put((char)(0x80 | (c & 0x3F)));
+            }
+            else {
+                put((char)(0xF0 | c >> 18));
+                put((char)(0x80 | (c >> 12 & 0x3F)));
+                put((char)(0x80 | (c >> 6 & 0x3F)));
+                put((char)(0x80 | (c & 0x3F)));
+            }
+        }
+        // Cell color as it is sent, RGB only stays RGB with true color.
+        uint32_t sent_color(uint32_t color, int x, int y) const
+        {
+            if (!(color & CELL_RGB))
+                return color;
+            if (trueColor && !reducedColor)
+                return color & (CELL_RGB | 0xFFFFFF);
+            return CellPaletteColor(color, QuantizeLUT::For(256), x, y);
+        }
+        void put_color(uint32_t color, bool fore)
+        {
+            if (trueColor && !reducedColor)
+            {
+                uint32_t rgb = CellColorRGB(color);
+                put(fore ? "38;2;" : "48;2;", 5);
+                put_uint(rgb >> 16);
+                put(';');
+                put_uint(rgb >> 8 & 0xFF);
+                put(';');
+                put_uint(rgb & 0xFF);
+            }
+            else if (color < 8)
+                put_uint((fore ? 30 : 40) + color);
+            else if (color < 16)
+                put_uint((fore ? 90 : 100) + color - 8);
+            else {
+                put(fore ? "38;5;" : "48;5;", 5);
+                put_uint(color);
+            }
+        }
+        void move_to(int row, int col)
+        {
+            put("\033[", 2);
+            put_uint(originY + row + 1);
+            put(';');
+            put_uint(originX + col + 1);
+            put('H');
+            curRow = row;
+            curCol = col;
+        }
+        void set_colors(uint32_t f, uint32_t b)
+        {
+            put("\033[", 2);
+            if (f != curF)
+                put_color(f, true);
+            if (f != curF && b != curB)
+                put(';');
+            if (b != curB)
+                put_color(b, false);
+            put('m');
+            curF = f;
+            curB = b;
+        }
+
+    public:
+        AnsiBackend(int fd, int originX, int originY, int termCols, bool trueColor)
+            : fd(fd), originX(originX), originY(originY), termCols(termCols), trueColor(trueColor)
+        {
+            out.reserve(1 << 16);
+        }
+
+        void BeginFrame() override
+        {
+            out.clear();
+        }
+        void PutCells(int row, int x, const Cell* cells, int n) override
+        {
+            if (row != curRow || x != curCol)
+                move_to(row, x);
+            for (int i = 0; i < n; i++)
+            {
+                const Cell& c = cells[i];
+                uint32_t f = sent_color(c.f, x + i, 2 * row + 1), b = sent_color(c.b, x + i, 2 * row);
+                if (f != curF || b != curB)
+                    set_colors(f, b);
+
+                if (c.ch == L'▄')
+                    put("\xE2\x96\x84", 3);
+                else
+                    put_utf8(c.ch);
+
+                // Past the right edge the terminal is waiting to wrap, and wide characters take two columns.
+                curCol++;
+                if (originX + curCol >= termCols || (c.ch >= 0x1100 && wcwidth(c.ch) != 1))
+                    curRow = curCol = -1;
+            }
+        }
+        bool EndFrame() override
+        {
+            bytesLast = out.size();
+            const char* p = out.data();
+            size_t left = out.size();
+            while (left > 0)
+            {
+                ssize_t w = write(fd, p, left);
+                if (w < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    // A non-blocking fd with a full queue, wait until the terminal reads some.
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        pollfd pfd = { fd, POLLOUT, 0 };
+                        if (poll(&pfd, 1, -1) >= 0 || errno == EINTR)
+                            continue;
+                    }
+                    // Part of the frame is lost and the cursor is somewhere in it.
+                    Invalidate();
+                    return false;
+                }
+                p += w;
+                left -= w;
+            }
+            return true;
+        }
+        void Invalidate() override
+        {
+            curRow = curCol = -1;
+            curF = curB = UNKNOWN;
+        }
+        size_t BytesLastFrame() const override { return bytesLast; }
+        size_t PendingBytes() const override { return queued_bytes(fd); }
+        void SetReducedColor(bool on) override { reducedColor = on; }
+    };
+}
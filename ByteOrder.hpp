@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace cge
+{
+    /*
+        Little-endian integers for the file formats, written and read byte by
+        byte so files are the same on every machine.
+    */
+    inline void StoreLE(uint8_t* at, uint64_t v, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+            at[i] = (uint8_t)(v >> (8 * i));
+    }
+    // Appends the low bytes of v to out, least significant first.
+    inline void PutLE(std::vector<uint8_t>& out, uint64_t v, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+            out.push_back((uint8_t)(v >> (8 * i)));
+    }
+    inline uint64_t LoadLE(const uint8_t* at, int bytes)
+    {
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; i++)
+            v |= (uint64_t)at[i] << (8 * i);
+        return v;
+    }
+}
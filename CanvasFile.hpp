@@ -0,0 +1,336 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Fragment.hpp"
+#include "ByteOrder.hpp"
+#include "DamageRegion.hpp"
+#include "Kernels.hpp"
+
+namespace cge
+{
+    /*
+        Picture of palette indices saved row by row, each row run-length encoded
+        on its own so rows can be decoded in any order. Little-endian layout:
+
+            header   "CGEC", u32 version (1), u32 width, u32 height
+            rows     height times a sequence of runs covering width pixels,
+                     a run is a byte n: bit 7 set for n & 0x7F + 1 transparent
+                     pixels, clear for n + 1 pixels of the color in the next byte
+            table    height times u64 offset of the row from the file start
+            trailer  u64 offset of the table, "CGEC"
+
+        The table goes last, so a file can be written in one pass without
+        knowing the row sizes up front.
+    */
+    namespace canvas_format
+    {
+        constexpr char MAGIC[4] = { 'C', 'G', 'E', 'C' };
+        constexpr uint32_t VERSION = 1;
+        constexpr size_t HEADER_SIZE = 16;
+        constexpr size_t TRAILER_SIZE = 12;
+        constexpr uint8_t TRANSPARENT = 0x80;
+        constexpr int MAX_RUN = 128;
+
+        // Appends the runs of n pixels to out.
+        inline void EncodeRow(const Fragment* row, int n, std::vector<uint8_t>& out)
+        {
+            for (int x = 0; x < n; )
+            {
+                const bool opaque = row[x].state;
+                const uint8_t color = row[x].f;
+                int run = 1;
+                while (run < MAX_RUN && x + run < n && row[x + run].state == opaque && (!opaque || row[x + run].f == color))
+                    run++;
+                if (opaque) {
+                    out.push_back((uint8_t)(run - 1));
+                    out.push_back(color);
+                }
+                else
+                    out.push_back((uint8_t)(TRANSPARENT | (run - 1)));
+                x += run;
+            }
+        }
+    }
+
+    /*
+        Saves a picture a few rows at a time, so a large canvas can be written
+        during a running frame loop. Begin() takes a copy of the picture, later
+        drawing does not end up in the file. The copy is kept for the next save,
+        so saving again does not allocate unless the picture grew. The file is written next to path
+        and renamed over it when complete, an interrupted save leaves the last
+        complete one in place.
+    */
+    class CanvasWriter
+    {
+        FILE* file = NULL;
+        std::string path, partPath;
+        Framebuffer image;
+        std::vector<uint64_t> offsets;
+        std::vector<uint8_t> line;
+        uint64_t written = 0;
+        int row = 0;
+        bool failed = false;
+
+        bool put(const void* data, size_t n)
+        {
+            if (fwrite(data, 1, n, file) != n)
+                return false;
+            written += n;
+            return true;
+        }
+        void fail()
+        {
+            fclose(file);
+            file = NULL;
+            remove(partPath.c_str());
+            failed = true;
+        }
+
+    public:
+        CanvasWriter() {}
+        CanvasWriter(const CanvasWriter&) = delete;
+        CanvasWriter& operator=(const CanvasWriter&) = delete;
+        ~CanvasWriter() { Cancel(); }
+
+        // Starts saving a copy of picture to path, false if the file cannot be created.
+        bool Begin(const std::string& filePath, const Framebuffer& picture)
+        {
+            Cancel();
+            failed = false;
+            path = filePath;
+            partPath = filePath + ".part";
+            file = fopen(partPath.c_str(), "wb");
+            if (!file) {
+                failed = true;
+                return false;
+            }
+            image.Resize(picture.Width(), picture.Height());
+            for (int y = 0; y < image.Height(); y++)
+                std::copy_n(picture.Row(y), image.Width(), image.Row(y));
+            offsets.clear();
+            offsets.reserve(image.Height());
+            written = 0;
+            row = 0;
+
+            line.assign(canvas_format::MAGIC, canvas_format::MAGIC + 4);
+            PutLE(line, canvas_format::VERSION, 4);
+            PutLE(line, (uint32_t)image.Width(), 4);
+            PutLE(line, (uint32_t)image.Height(), 4);
+            if (!put(line.data(), line.size())) {
+                fail();
+                return false;
+            }
+            return true;
+        }
+        /*
+            Writes up to rows more rows, and the table once all rows are out. True
+            while there is more to write, Failed() tells how it ended.
+        */
+        bool Step(int rows)
+        {
+            if (!file)
+                return false;
+            for (int end = std::min(image.Height(), row + rows); row < end; row++)
+            {
+                line.clear();
+                canvas_format::EncodeRow(image.Row(row), image.Width(), line);
+                offsets.push_back(written);
+                if (!put(line.data(), line.size())) {
+                    fail();
+                    return false;
+                }
+            }
+            if (row < image.Height())
+                return true;
+
+            line.clear();
+            for (uint64_t offset : offsets)
+                PutLE(line, offset, 8);
+            PutLE(line, written, 8);
+            line.insert(line.end(), canvas_format::MAGIC, canvas_format::MAGIC + 4);
+            bool ok = put(line.data(), line.size());
+            ok = fflush(file) == 0 && ok;
+            ok = fclose(file) == 0 && ok;
+            file = NULL;
+            if (!ok || rename(partPath.c_str(), path.c_str()) != 0) {
+                remove(partPath.c_str());
+                failed = true;
+            }
+            return false;
+        }
+        // Drops a save in progress.
+        void Cancel()
+        {
+            if (!file)
+                return;
+            fclose(file);
+            file = NULL;
+            remove(partPath.c_str());
+        }
+        bool Busy() const { return file != NULL; }
+        bool Failed() const { return failed; }
+        // Rows written so far out of Rows().
+        int Progress() const { return row; }
+        int Rows() const { return image.Height(); }
+
+        // Saves picture to path in one go.
+        static bool Save(const std::string& path, const Framebuffer& picture)
+        {
+            CanvasWriter w;
+            if (!w.Begin(path, picture))
+                return false;
+            while (w.Step(picture.Height())) {}
+            return !w.Failed();
+        }
+    };
+
+    /*
+        Saved picture mapped into memory. Opening only checks the header and the
+        row table, rows are decoded when asked for, so only the rows that get
+        shown are ever read from disk.
+    */
+    class CanvasFile
+    {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        int width = 0, height = 0;
+        size_t table = 0;
+        std::vector<bool> loaded;  // rows Load() has decoded
+
+        uint32_t read_u32(size_t at) const { return (uint32_t)LoadLE(data + at, 4); }
+        uint64_t read_u64(size_t at) const { return LoadLE(data + at, 8); }
+        // Start and end of row y, false if the table points outside of the rows.
+        bool row_bounds(int y, size_t& begin, size_t& end) const
+        {
+            begin = read_u64(table + (size_t)y * 8);
+            end = y + 1 < height ? read_u64(table + (size_t)(y + 1) * 8) : table;
+            return canvas_format::HEADER_SIZE <= begin && begin <= end && end <= table;
+        }
+
+    public:
+        CanvasFile() {}
+        CanvasFile(const CanvasFile&) = delete;
+        CanvasFile& operator=(const CanvasFile&) = delete;
+        ~CanvasFile() { Close(); }
+
+        // False if the file cannot be mapped or is not a canvas.
+        bool Open(const std::string& path)
+        {
+            Close();
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            void* map = MAP_FAILED;
+            if (fstat(fd, &st) == 0 && (size_t)st.st_size >= canvas_format::HEADER_SIZE + canvas_format::TRAILER_SIZE)
+                map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            // The mapping stays valid without the descriptor.
+            close(fd);
+            if (map == MAP_FAILED)
+                return false;
+
+            data = static_cast<const uint8_t*>(map);
+            size = st.st_size;
+            uint32_t w = read_u32(8), h = read_u32(12);
+            uint64_t t = read_u64(size - canvas_format::TRAILER_SIZE);
+            bool valid = memcmp(data, canvas_format::MAGIC, 4) == 0 && read_u32(4) == canvas_format::VERSION
+                && memcmp(data + size - 4, canvas_format::MAGIC, 4) == 0
+                && w <= INT32_MAX && h <= INT32_MAX && t >= canvas_format::HEADER_SIZE
+                && t <= size - canvas_format::TRAILER_SIZE && (size - canvas_format::TRAILER_SIZE - t) / 8 == h
+                && (size - canvas_format::TRAILER_SIZE - t) % 8 == 0;
+            if (!valid) {
+                Close();
+                return false;
+            }
+            width = (int)w;
+            height = (int)h;
+            table = (size_t)t;
+            loaded.assign(height, false);
+            return true;
+        }
+        void Close()
+        {
+            if (data)
+                munmap(const_cast<uint8_t*>(data), size);
+            data = nullptr;
+            size = 0;
+            width = height = 0;
+            loaded.clear();
+        }
+        bool IsOpen() const { return data != nullptr; }
+        int Width() const { return width; }
+        int Height() const { return height; }
+
+        /*
+            Decodes the first n pixels of row y into dst, pixels past the width of
+            the picture are transparent. False for a bad row, which comes out
+            transparent where it is broken.
+        */
+        bool ReadRow(int y, Fragment* dst, int n) const
+        {
+            const Fragment clear{ 0, 0, false };
+            const Kernels& kernels = Kernels::Best();
+            size_t at, end;
+            if (y < 0 || y >= height || !row_bounds(y, at, end)) {
+                kernels.fill(dst, (size_t)std::max(n, 0), clear);
+                return false;
+            }
+            int x = 0;
+            const int stop = std::min(n, width);
+            while (x < stop && at < end)
+            {
+                uint8_t run = data[at++];
+                int count = (run & ~canvas_format::TRANSPARENT) + 1;
+                Fragment v = clear;
+                if (!(run & canvas_format::TRANSPARENT)) {
+                    if (at == end)
+                        break;
+                    v = Fragment{ data[at], data[at], true };
+                    at++;
+                }
+                count = std::min(count, stop - x);
+                kernels.fill(dst + x, (size_t)count, v);
+                x += count;
+            }
+            bool ok = x == stop;
+            if (x < n)
+                kernels.fill(dst + x, (size_t)(n - x), clear);
+            return ok;
+        }
+        /*
+            Decodes rows y0..y1 into the same rows of fb, clipped to its width, at
+            most maxRows of them and only rows not loaded before. Rows it decoded
+            are added to changed. Returns how many rows it decoded.
+        */
+        int Load(Framebuffer& fb, int y0, int y1, int maxRows, DamageRegion* changed = nullptr)
+        {
+            y0 = std::max(y0, 0);
+            y1 = std::min({ y1, height - 1, fb.Height() - 1 });
+            int done = 0;
+            for (int y = y0; y <= y1 && done < maxRows; y++)
+            {
+                if (loaded[y])
+                    continue;
+                ReadRow(y, fb.Row(y), fb.Width());
+                loaded[y] = true;
+                done++;
+                if (changed)
+                    changed->Add(0, y, fb.Width() - 1, y);
+            }
+            return done;
+        }
+        // Makes Load() decode every row again, for when its target was cleared.
+        void Unload()
+        {
+            std::fill(loaded.begin(), loaded.end(), false);
+        }
+    };
+}
@@ -0,0 +1,199 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include "Fragment.hpp"
+#include "DamageRegion.hpp"
+
+namespace cge
+{
+    /*
+        Undo and redo for a picture, kept as a grid of TILE x TILE tiles. Every
+        version of the picture shares the tiles it has in common with the others,
+        a step only holds the tiles it replaced, so the history grows with what
+        was changed and not with the number of steps. Undo and redo swap tile
+        pointers, only the tiles that differ are copied back into the picture.
+        Old steps are dropped once the history takes more than its budget.
+    */
+    class CanvasHistory
+    {
+    public:
+        static constexpr int TILE = 32;
+        static constexpr size_t TILE_BYTES = sizeof(Fragment) * TILE * TILE;
+
+    private:
+        struct Tile
+        {
+            Fragment pixels[TILE * TILE];
+        };
+        typedef std::shared_ptr<const Tile> TilePtr;
+        struct Change
+        {
+            uint32_t tile;
+            TilePtr before, after;
+        };
+        // The tiles of one edit, each step owns one side of its changes.
+        typedef std::vector<Change> Step;
+
+        std::vector<TilePtr> current;  // the picture as of the last Commit(), Undo() or Redo()
+        std::deque<Step> undo;
+        std::vector<Step> redo;
+        size_t budget;
+        size_t used = 0;  // bytes of the tiles held by the steps
+        int width = 0, height = 0, columns = 0, rows = 0;
+
+        DamageRect tile_rect(uint32_t i) const
+        {
+            int x = (int)(i % columns) * TILE, y = (int)(i / columns) * TILE;
+            return DamageRect{ x, y, std::min(x + TILE, width) - 1, std::min(y + TILE, height) - 1 };
+        }
+        // Tile i of the picture, the part outside of the picture is zero.
+        std::shared_ptr<Tile> copy_tile(const Framebuffer& picture, uint32_t i) const
+        {
+            auto tile = std::make_shared<Tile>();
+            std::fill_n(tile->pixels, TILE * TILE, Fragment{ 0, 0, false });
+            DamageRect r = tile_rect(i);
+            for (int y = r.y0; y <= r.y1; y++)
+                memcpy(tile->pixels + (y - r.y0) * TILE, picture.Span(r.x0, y), (size_t)(r.x1 - r.x0 + 1) * sizeof(Fragment));
+            return tile;
+        }
+        bool same(const Framebuffer& picture, uint32_t i, const Tile& tile) const
+        {
+            DamageRect r = tile_rect(i);
+            for (int y = r.y0; y <= r.y1; y++)
+                if (memcmp(tile.pixels + (y - r.y0) * TILE, picture.Span(r.x0, y), (size_t)(r.x1 - r.x0 + 1) * sizeof(Fragment)) != 0)
+                    return false;
+            return true;
+        }
+        void paste(Framebuffer& picture, uint32_t i, const Tile& tile, DamageRegion* changed) const
+        {
+            DamageRect r = tile_rect(i);
+            for (int y = r.y0; y <= r.y1; y++)
+                memcpy(picture.Span(r.x0, y), tile.pixels + (y - r.y0) * TILE, (size_t)(r.x1 - r.x0 + 1) * sizeof(Fragment));
+            if (changed)
+                changed->Add(r);
+        }
+        void trim()
+        {
+            while (used > budget && !undo.empty()) {
+                used -= undo.front().size() * TILE_BYTES;
+                undo.pop_front();
+            }
+        }
+        void drop_redo()
+        {
+            for (const Step& s : redo)
+                used -= s.size() * TILE_BYTES;
+            redo.clear();
+        }
+
+    public:
+        // budget is in bytes and does not count the current picture.
+        CanvasHistory(size_t budgetBytes = 64u << 20) : budget(budgetBytes) {}
+
+        // Forgets every step and starts over from picture.
+        void Reset(const Framebuffer& picture)
+        {
+            undo.clear();
+            redo.clear();
+            used = 0;
+            width = picture.Width();
+            height = picture.Height();
+            columns = (width + TILE - 1) / TILE;
+            rows = (height + TILE - 1) / TILE;
+            current.assign((size_t)columns * rows, nullptr);
+            // Neighbouring tiles that are alike, like empty ones, share one copy.
+            TilePtr last;
+            for (uint32_t i = 0; i < current.size(); i++)
+            {
+                if (!last || !same(picture, i, *last))
+                    last = copy_tile(picture, i);
+                current[i] = last;
+            }
+        }
+        bool Matches(const Framebuffer& picture) const
+        {
+            return picture.Width() == width && picture.Height() == height;
+        }
+
+        /*
+            Records the changes of picture within region as one step, tiles in it
+            that did not change are not kept. Drops the steps that could be redone.
+            Returns false if nothing changed.
+        */
+        bool Commit(const Framebuffer& picture, const DamageRegion& region)
+        {
+            if (!Matches(picture) || current.empty())
+                return false;
+            std::vector<bool> seen(current.size(), false);
+            Step step;
+            for (const DamageRect& r : region.Rects())
+            {
+                int tx0 = std::max(r.x0, 0) / TILE, tx1 = std::min(r.x1, width - 1) / TILE;
+                int ty0 = std::max(r.y0, 0) / TILE, ty1 = std::min(r.y1, height - 1) / TILE;
+                for (int ty = ty0; ty <= ty1; ty++)
+                    for (int tx = tx0; tx <= tx1; tx++)
+                    {
+                        uint32_t i = (uint32_t)(ty * columns + tx);
+                        if (seen[i])
+                            continue;
+                        seen[i] = true;
+                        if (same(picture, i, *current[i]))
+                            continue;
+                        TilePtr tile = copy_tile(picture, i);
+                        step.push_back(Change{ i, current[i], tile });
+                        current[i] = tile;
+                    }
+            }
+            if (step.empty())
+                return false;
+            drop_redo();
+            used += step.size() * TILE_BYTES;
+            undo.push_back(std::move(step));
+            trim();
+            return true;
+        }
+        /*
+            Puts the tiles of the last step back into picture, adding what changed
+            to changed. False if there is nothing to undo.
+        */
+        bool Undo(Framebuffer& picture, DamageRegion* changed = nullptr)
+        {
+            if (undo.empty() || !Matches(picture))
+                return false;
+            for (const Change& c : undo.back()) {
+                current[c.tile] = c.before;
+                paste(picture, c.tile, *c.before, changed);
+            }
+            redo.push_back(std::move(undo.back()));
+            undo.pop_back();
+            return true;
+        }
+        bool Redo(Framebuffer& picture, DamageRegion* changed = nullptr)
+        {
+            if (redo.empty() || !Matches(picture))
+                return false;
+            for (const Change& c : redo.back()) {
+                current[c.tile] = c.after;
+                paste(picture, c.tile, *c.after, changed);
+            }
+            undo.push_back(std::move(redo.back()));
+            redo.pop_back();
+            return true;
+        }
+        bool CanUndo() const { return !undo.empty(); }
+        bool CanRedo() const { return !redo.empty(); }
+        size_t UndoSteps() const { return undo.size(); }
+        size_t RedoSteps() const { return redo.size(); }
+        // Bytes the steps take, at most the budget once the next step is committed.
+        size_t MemoryUsed() const { return used; }
+        void SetBudget(size_t bytes)
+        {
+            budget = bytes;
+            trim();
+        }
+    };
+}
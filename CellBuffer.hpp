@@ -0,0 +1,153 @@
+#pragma once
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include "DamageRegion.hpp"
+#include "Palette.hpp"
+
+namespace cge
+{
+    /*
+        Colors of cells are palette indices, or 0xRRGGBB with CELL_RGB set for
+        pixels drawn with RGB. CELL_DITHER asks for dithering where the terminal
+        needs a palette color instead.
+    */
+    constexpr uint32_t CELL_RGB = 1u << 24;
+    constexpr uint32_t CELL_DITHER = 1u << 25;
+
+    inline uint32_t CellColorRGB(uint32_t color)
+    {
+        return color & CELL_RGB ? color & 0xFFFFFF : PaletteRGB((uint8_t)color);
+    }
+
+    // One terminal character cell, with colors already resolved.
+    struct alignas(16) Cell
+    {
+        uint32_t f;
+        uint32_t b;
+        wchar_t ch;
+
+        bool operator==(const Cell& c) const { return ch == c.ch && f == c.f && b == c.b; }
+        bool operator!=(const Cell& c) const { return !(*this == c); }
+    };
+    static_assert(sizeof(Cell) == 16, "Cell is expected to fill 16 bytes, the kernels store whole cells");
+
+    // Never produced by drawing, so a cell set to this is always repainted.
+    constexpr Cell INVALID_CELL = { 0, 0, L'\0' };
+
+    // Grid of cells, one per terminal character, stored row by row.
+    class CellBuffer
+    {
+        std::vector<Cell> cells;
+        int width = 0;
+        int height = 0;
+
+    public:
+        void Resize(int w, int h, const Cell& fill = INVALID_CELL)
+        {
+            width = w;
+            height = h;
+            cells.assign((size_t)w * h, fill);
+        }
+        void Fill(const Cell& c)
+        {
+            std::fill(cells.begin(), cells.end(), c);
+        }
+        int Width() const { return width; }
+        int Height() const { return height; }
+        Cell* Row(int y) { return cells.data() + (size_t)y * width; }
+        const Cell* Row(int y) const { return cells.data() + (size_t)y * width; }
+        Cell& At(int x, int y) { return cells[(size_t)y * width + x]; }
+        const Cell& At(int x, int y) const { return cells[(size_t)y * width + x]; }
+    };
+
+    /*
+        Remembers what was presented last and hands out only the cells
+        that changed since then, as horizontal runs.
+    */
+    class DiffPresenter
+    {
+        CellBuffer front;
+        unsigned long cellsLast = 0;
+        DamageRegion invalid;  // cells a region limited Present() has to look at anyway
+
+        template<typename Emit>
+        void present_span(const CellBuffer& back, int y, int x0, int x1, Emit& emit)
+        {
+            const Cell* src = back.Row(y);
+            Cell* dst = front.Row(y);
+            int x = x0;
+            while (x <= x1)
+            {
+                if (src[x] == dst[x]) {
+                    x++;
+                    continue;
+                }
+                int start = x;
+                for (; x <= x1 && src[x] != dst[x]; x++)
+                    dst[x] = src[x];
+                emit(y, start, src + start, x - start);
+                cellsLast += x - start;
+            }
+        }
+
+    public:
+        void Resize(int cols, int rows)
+        {
+            front.Resize(cols, rows);
+            invalid.Resize(cols, rows);
+            invalid.AddAll();
+        }
+        // Forces the next Present() to emit every cell.
+        void Invalidate()
+        {
+            front.Fill(INVALID_CELL);
+            invalid.AddAll();
+        }
+        void Invalidate(int x, int y, int n)
+        {
+            if (y < 0 || y >= front.Height())
+                return;
+            Cell* row = front.Row(y);
+            for (int i = std::max(x, 0); i < x + n && i < front.Width(); i++)
+                row[i] = INVALID_CELL;
+            invalid.Add(x, y, x + n - 1, y);
+        }
+        // Number of cells emitted by the last Present().
+        unsigned long CellsLastFrame() const { return cellsLast; }
+        const CellBuffer& Front() const { return front; }
+
+        /*
+            Calls emit(row, x, cells, n) for every run of changed cells in back
+            and records them as presented. Runs never span more than one row.
+        */
+        template<typename Emit>
+        void Present(const CellBuffer& back, Emit&& emit)
+        {
+            cellsLast = 0;
+            for (int y = 0; y < back.Height(); y++)
+                present_span(back, y, 0, back.Width() - 1, emit);
+            invalid.Clear();
+        }
+        /*
+            Same, but only compares the cells inside damage, a region in cells.
+            The caller guarantees nothing changed outside of it.
+        */
+        template<typename Emit>
+        void Present(const CellBuffer& back, const DamageRegion& damage, Emit&& emit)
+        {
+            if (invalid.Full() || damage.Full()) {
+                Present(back, emit);
+                return;
+            }
+            cellsLast = 0;
+            // Overlapping rectangles are harmless, cells presented once compare equal afterwards.
+            for (const DamageRegion* region : { &damage, &std::as_const(invalid) })
+                for (const DamageRect& r : region->Rects())
+                    for (int y = r.y0; y <= std::min(r.y1, back.Height() - 1); y++)
+                        present_span(back, y, r.x0, std::min(r.x1, back.Width() - 1), emit);
+            invalid.Clear();
+        }
+    };
+}
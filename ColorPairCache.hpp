@@ -0,0 +1,194 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+namespace cge
+{
+    struct ColorPairStats
+    {
+        unsigned long hits = 0;
+        unsigned long misses = 0;
+        unsigned long evictions = 0;
+        unsigned long failures = 0;  // pairs the terminal refused to define
+    };
+
+    /*
+        Maps (foreground, background) to a color pair slot. Slots are handed out
+        until the terminal's pair budget is used up, after that the least
+        recently used pair is redefined. Cells already on screen that used it
+        change color with it, see Evicted().
+    */
+    class ColorPairCache
+    {
+    public:
+        typedef int (*InitPairFn)(int pair, int f, int b);
+
+    private:
+        static constexpr uint16_t NONE = 0;
+
+        struct Slot
+        {
+            uint16_t key;
+            uint16_t prev, next;  // LRU list, NONE terminates
+            uint32_t lastUse;     // frame the pair was last looked up in
+        };
+
+        InitPairFn initPair;
+        std::vector<uint16_t> slotOf;  // key -> slot, NONE when not defined
+        std::vector<Slot> slots;       // slots[0] is unused, pair 0 is reserved by curses
+        int budget = 0;
+        int used = 0;
+        uint16_t head = NONE, tail = NONE;
+        uint32_t frame = 0;
+        int frameDistinct = 0;  // pairs looked up this frame
+        std::vector<uint8_t> evicted;  // key -> 1 when its pair was redefined since ClearEvicted()
+        bool anyEvicted = false;
+        ColorPairStats stats;
+
+        static uint16_t key_of(uint8_t f, uint8_t b) { return (uint16_t)(f << 8 | b); }
+
+        void unlink(uint16_t s)
+        {
+            Slot& n = slots[s];
+            if (n.prev != NONE) slots[n.prev].next = n.next; else head = n.next;
+            if (n.next != NONE) slots[n.next].prev = n.prev; else tail = n.prev;
+        }
+        void push_front(uint16_t s)
+        {
+            slots[s].prev = NONE;
+            slots[s].next = head;
+            if (head != NONE)
+                slots[head].prev = s;
+            head = s;
+            if (tail == NONE)
+                tail = s;
+        }
+        void push_back(uint16_t s)
+        {
+            slots[s].next = NONE;
+            slots[s].prev = tail;
+            if (tail != NONE)
+                slots[tail].next = s;
+            tail = s;
+            if (head == NONE)
+                head = s;
+        }
+        int define(uint8_t f, uint8_t b)
+        {
+            uint16_t s;
+            if (used < budget)
+                s = (uint16_t)++used;
+            else
+            {
+                s = tail;
+                unlink(s);
+                const uint16_t old = slots[s].key;
+                // A slot whose definition failed holds no pair.
+                if (slotOf[old] == s) {
+                    slotOf[old] = NONE;
+                    stats.evictions++;
+                    // A pair this frame used already stays as it is, see OverBudget().
+                    if (slots[s].lastUse != frame) {
+                        evicted[old] = 1;
+                        anyEvicted = true;
+                    }
+                }
+            }
+            // Curses returns OK, which is 0, or ERR.
+            if (initPair(s, f, b) != 0) {
+                // Left unmapped and first in line to be taken again.
+                stats.failures++;
+                slots[s].key = NONE;
+                push_back(s);
+                return 0;
+            }
+            frameDistinct++;
+            slots[s].key = key_of(f, b);
+            slots[s].lastUse = frame;
+            slotOf[slots[s].key] = s;
+            push_front(s);
+            return s;
+        }
+
+    public:
+        ColorPairCache(InitPairFn initPair) : initPair(initPair), slotOf(256 * 256, NONE), evicted(256 * 256, 0) {}
+
+        // Forgets every pair and sets how many pairs the terminal supports.
+        void Reset(int colorPairs)
+        {
+            budget = std::clamp(colorPairs - 1, 0, 0xFFFF);
+            slots.assign(budget + 1, Slot{ 0, NONE, NONE, 0 });
+            std::fill(slotOf.begin(), slotOf.end(), NONE);
+            used = 0;
+            head = tail = NONE;
+            ClearEvicted();
+        }
+        // Pairs looked up from here on belong to a new frame.
+        void BeginFrame()
+        {
+            frame++;
+            frameDistinct = 0;
+        }
+        /*
+            True when this frame alone needed more pairs than the budget. Some of
+            its cells show wrong colors then, and painting the cells of evicted
+            pairs again would only push out others the next frame.
+        */
+        bool OverBudget() const { return frameDistinct > budget; }
+        // Returns the pair number for the given colors, defining it if needed.
+        int Get(uint8_t f, uint8_t b)
+        {
+            uint16_t s = slotOf[key_of(f, b)];
+            if (s != NONE)
+            {
+                stats.hits++;
+                if (slots[s].lastUse != frame) {
+                    slots[s].lastUse = frame;
+                    frameDistinct++;
+                }
+                if (s != head) {
+                    unlink(s);
+                    push_front(s);
+                }
+                return s;
+            }
+            stats.misses++;
+            if (budget == 0)
+                return 0;
+            return define(f, b);
+        }
+        /*
+            Defines all pairs of the first `colors` colors up front, while leaving
+            at least half of the budget free for everything else.
+        */
+        void Prewarm(int colors)
+        {
+            colors = std::clamp(colors, 0, 256);
+            for (int f = 0; f < colors; f++)
+                for (int b = 0; b < colors; b++)
+                {
+                    if (used >= budget / 2)
+                        return;
+                    if (slotOf[key_of(f, b)] == NONE)
+                        define(f, b);
+                }
+        }
+        /*
+            Whether the pair of these colors was redefined for others since
+            ClearEvicted(). Cells on screen in these colors may show the new ones.
+        */
+        bool Evicted(uint8_t f, uint8_t b) const { return evicted[key_of(f, b)]; }
+        bool AnyEvicted() const { return anyEvicted; }
+        void ClearEvicted()
+        {
+            if (anyEvicted)
+                std::fill(evicted.begin(), evicted.end(), 0);
+            anyEvicted = false;
+        }
+        int Budget() const { return budget; }
+        int Used() const { return used; }
+        const ColorPairStats& Stats() const { return stats; }
+        void ResetStats() { stats = ColorPairStats(); }
+    };
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <ncurses.h>
+#include <vector>
+#include <unistd.h>
+#include "OutputBackend.hpp"
+#include "ColorPairCache.hpp"
+#include "Quantize.hpp"
+
+namespace cge
+{
+    /*
+        Writes cells into a curses window and lets ncurses refresh the terminal.
+        RGB cell colors become the nearest colors of lut.
+    */
+    class CursesBackend : public OutputBackend
+    {
+        WINDOW* win;
+        ColorPairCache& pairs;
+        const QuantizeLUT& lut;
+        std::vector<wchar_t> runChars;
+        std::vector<uint8_t> runF, runB;
+
+    public:
+        CursesBackend(WINDOW* win, ColorPairCache& pairs, const QuantizeLUT& lut)
+            : win(win), pairs(pairs), lut(lut), runChars(getmaxx(win)), runF(getmaxx(win)), runB(getmaxx(win)) {}
+
+        void PutCells(int row, int x, const Cell* cells, int n) override
+        {
+            for (int i = 0; i < n; i++)
+            {
+                runF[i] = CellPaletteColor(cells[i].f, lut, x + i, 2 * row + 1);
+                runB[i] = CellPaletteColor(cells[i].b, lut, x + i, 2 * row);
+            }
+            // One attribute change and one write per group of equally colored cells.
+            int i = 0;
+            while (i < n)
+            {
+                int j = i;
+                for (; j < n && runF[j] == runF[i] && runB[j] == runB[i]; j++)
+                    runChars[j - i] = cells[j].ch;
+                int pair = pairs.Get(runF[i], runB[i]);
+                wattr_set(win, WA_NORMAL, 0, &pair);
+                mvwaddnwstr(win, row, x + i, runChars.data(), j - i);
+                i = j;
+            }
+        }
+        bool EndFrame() override
+        {
+            return wrefresh(win) != ERR;
+        }
+        void Invalidate() override
+        {
+            touchwin(win);
+        }
+        // ncurses writes to stdout unless it was set up with newterm().
+        size_t PendingBytes() const override { return queued_bytes(STDOUT_FILENO); }
+    };
+}
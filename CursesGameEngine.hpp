@@ -1,26 +1,49 @@
 #pragma once
 #include <ncurses.h>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <vector>
 #include <chrono>
 #include <clocale>
+#include <cctype>
 #include <cmath>
 #include <algorithm>
 #include <thread>
+#include <memory>
+#include <cstdio>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <poll.h>
+#include <unistd.h>
 #include "Vec2_generic.hpp"
-#include "tsqueue.hpp"
+#include "Affine2_generic.hpp"
+#include "TextArena.hpp"
+#include "InputEvent.hpp"
+#include "ringqueue.hpp"
+#include "CellBuffer.hpp"
+#include "Fragment.hpp"
+#include "ColorPairCache.hpp"
+#include "CursesBackend.hpp"
+#include "AnsiBackend.hpp"
+#include "Palette.hpp"
+#include "Raster.hpp"
+#include "FramePacer.hpp"
+#include "TileRasterizer.hpp"
+#include "DisplayList.hpp"
+#include "TripleBuffer.hpp"
+#include "DamageRegion.hpp"
+#include "Kernels.hpp"
+#include "Sprite.hpp"
+#include "LayerStack.hpp"
+#include "RenderMode.hpp"
+#include "Profiler.hpp"
+#include "OutputMonitor.hpp"
+#include "Quantize.hpp"
+#include "InputLog.hpp"
 #define BLOCK_BOT L"▄"
 
-#define NEW_2D_ARRAY(arr, type, x, y)\
-    arr = new type*[x];\
-    for (auto i = 0; i < x; i++)\
-        arr[i] = new type[y];
-#define DELETE_2D_ARRAY(x, arr)\
-    for (auto i = 0; i < x; i++)\
-        delete[] arr[i];\
-    delete[] arr;
-
 using std::string;
 using std::vector;
 using namespace std::literals::chrono_literals;
@@ -29,87 +52,140 @@ namespace cge
 {    
     typedef std::chrono::high_resolution_clock Time;
     typedef cge::Vec2_generic<float> Vec2f;
+    typedef cge::Affine2_generic<float> Affine2f;
+    typedef cge::Points2_generic<float> Points2f;
 
     enum class Align : uint8_t { Left, Center, Right };
-    struct Fragment
-    {
-        uint8_t f;
-        uint8_t b;
-        //wchar_t ch[2];
-        bool state;
-
-        uint8_t GetColor() { return state ? f : b; }
-    };
-    struct cge_string
-    {
-        std::wstring str;
-        int x, y;
-        bool alpha;
-        uint8_t f;
-    };
     class CursesGameEngine
     {
     private:
         bool y_offset_odd = false;        
-        bool *pair_defined;
+        ColorPairCache pairs{ init_extended_pair };
         int y_last_odd = false;
         int x_offset = 0, y_offset = 0;
         int win_width = 0;
         int win_height = 0;
         float timeFromStart = 0.0f;
-        float msPerFrame = 1000.0f / 60.0f;
-        std::vector<int> inputBuffer;
-        tsqueue<cge_string> strQueue;
+        FramePacer pacer;
+        bool deferred = false;
+        TileRasterizer tiles;
+        // Pipelined presenting, see SetPipelinedPresent().
+        bool pipelined = false;
+        std::thread presentThread;
+        std::atomic<bool> presenting{ false };
+        std::mutex frameMutex;
+        std::condition_variable frameReady;
+        std::atomic<unsigned long> droppedPresents{ 0 };
+        // ncurses is not thread safe, whoever talks to it holds this.
+        std::mutex cursesMutex;
+        // Input of this frame, moves already coalesced.
+        std::vector<InputEvent> frameInput;
+        InputReader inputReader;
+        // Input read on its own thread, see SetInputThread().
+        bool threadedInput = false;
+        std::thread inputThread;
+        std::atomic<bool> reading{ false };
+        spsc_queue<InputEvent> inputQueue{ 1024 };
+        /*
+            Strings are drained once per frame. DrawString() may be called from several
+            threads at once, as long as they are done before OnGameUpdate() returns.
+        */
+        TextArena text;
+        TextRun textBatch[64];
         MEVENT mouseEvent;        
+        // Resolved cells of the frames being built and presented, and the snapshot of what is on screen.
+        TripleBuffer<CellBuffer> frames;
+        DiffPresenter presenter;
+        std::unique_ptr<OutputBackend> output;
+        bool terminal = false;
+        bool headless = false;
+        unsigned long frameCount = 0;
+        unsigned long frameLimit = 0;
+        float fixedDelta = 0.0f;
+        std::string frameDumpPattern;
+        std::vector<uint64_t> frameChecksums;
+        // Damage tracking, see SetDamageTracking(). Regions are in pixels unless noted.
+        static constexpr int DAMAGE_HISTORY = 4;
+        bool damageTracking = false;
+        DamageRegion damage;            // changed this frame
+        DamageRegion drawn, prevDrawn;  // drawn this frame and before it since the last Clear(), what Clear() has to wipe
+        DamageRegion cleared;           // wiped by Clear() this frame
+        bool clearedThisFrame = false;
+        bool clearValid = false;        // pixels outside of drawn and prevDrawn have clearColor
+        uint8_t clearColor = COLOR_BLACK;
+        // Display list each back buffer pixel was composited from, 0 = none, and the frame + 1 each list
+        // was last drawn in. Pixels of a list not drawn yet this frame are what it left last time.
+        Framebuffer_generic<uint32_t> listPixels;
+        std::vector<unsigned long> listFrames;
+        std::vector<const DisplayList*> frameLists;  // drawn this frame since Clear(), in order
+        DamageRect listBounds{ 0, 0, -1, -1 };  // every nonzero listPixels lies inside
+        DamageRegion frameCells;        // cells resolved this frame, in cells
+        DamageRegion textCells;         // cells under this frame's text, in cells
+        DamageRegion cellHistory[DAMAGE_HISTORY], textHistory[DAMAGE_HISTORY];  // by frame number
+        unsigned long bufferFrame[3] = { 0, 0, 0 };  // frame each cell buffer was last resolved in, 0 = never
+        // Where drawing goes, see SetDrawTarget().
+        Framebuffer* target = &back_buffer;
+        Layer* targetLayer = nullptr;
+        // Pixels per character, see SetRenderMode().
+        RenderMode renderMode = RenderMode::HalfBlock;
+        int cellW = 1, cellH = 2;
+        // Frame phase timings, see SetProfiling().
+        FrameProfiler profiler;
+        bool profilerOverlay = false;
+        // Backpressure from a slow terminal, see SetOutputBackpressure().
+        bool backpressure = true;
+        OutputMonitor outputMonitor;                 // used by whichever thread presents
+        std::atomic<OutputLevel> outputLevel{ OutputLevel::Normal };
+        OutputLevel reportedLevel = OutputLevel::Normal;
+        int paletteColors = 256;                     // colors RGB is quantized to where the terminal lacks it
+        // Colors of the back buffer pixels with rgb set, as cell colors, see DrawRGB().
+        RGBFramebuffer back_rgb;
+        DamageRect rgbBounds{ 0, 0, -1, -1 };        // every pixel with rgb set lies inside
+        bool presentAll = false;                     // a frame was skipped, the next present compares every cell
+        unsigned long skippedPresents = 0;
+        // Input written to or played from a log, see RecordInput() and ReplayInput().
+        InputRecorder recorder;
+        InputReplay replay;
+        bool replaying = false;
 
     protected:
         WINDOW* win = NULL;        
         // Back buffer width and height are same as win width and height.
-        Fragment** back_buffer = NULL;        
+        Framebuffer back_buffer;
         uint8_t outColor = COLOR_BLACK;        
 
     public:
         std::vector<std::string> Errors;
         CursesGameEngine() {        
             setlocale(LC_CTYPE, "en_US.UTF-8");
-            initscr();
-            if (has_colors())
-                start_color();
-            cbreak();
-            mousemask(ALL_MOUSE_EVENTS | REPORT_MOUSE_POSITION, NULL);    
-            printf("\033[?1003h\n"); // Makes the terminal report mouse movement events
-            mouseinterval(0);
-            curs_set(false);            
-
-            pair_defined = new bool[COLOR_PAIRS];
-            for (auto i = 0; i < COLOR_PAIRS; i++)
-                pair_defined[i] = false;
         }
         virtual ~CursesGameEngine()
         {            
+            output.reset();
+            if (!terminal)
+                return;
             flushinp();
             // Delete allocated memory
             if (win)
                 delwin(win);
             printf("\033[?1003l\n"); // Disable mouse movement events, as l = low
             endwin();
-            //back_buffer[1000][1000] = Fragment{1, 2, 1};
-
-            //DELETE_2D_ARRAY(win_width, back_buffer);
-            for (auto i = 0; i < win_width; i++)
-                delete[] back_buffer[i];
-            delete[] back_buffer;
-            delete[] pair_defined;
         }        
-        bool Construct(int width, int height, int x, int y, bool sameSides)
+        /*
+            Creates the drawing window. Negative width/height take the whole terminal and
+            negative x/y center the window. The backend decides how frames reach the terminal.
+        */
+        bool Construct(int width, int height, int x, int y, bool sameSides, Backend backend = Backend::Curses)
         {
-            if (width > getmaxx(stdscr) || height > getmaxy(stdscr)*2) {
+            init_terminal();
+            paletteColors = has_colors() ? COLORS : 8;
+            if (width > getmaxx(stdscr) * cellW || height > getmaxy(stdscr) * cellH) {
                 Errors.push_back("[ERROR] cge::CursesGameEngine::Construct: Specified width or height is higher than stdscr dimensions! Not constructed.");                
                 return false;
             }
 
-            win_width = (width >= 0) ? width : getmaxx(stdscr);
-            win_height = (height >= 0) ? height : getmaxy(stdscr) * 2;  // two rows in one character
+            win_width = (width >= 0) ? width : getmaxx(stdscr) * cellW;
+            win_height = (height >= 0) ? height : getmaxy(stdscr) * cellH;
             if (sameSides) {
                 if (win_width > win_height)
                     win_width = win_height;
@@ -117,18 +193,39 @@ namespace cge
                     win_height = win_width;
             }
 
-            x = (x >= 0) ? x : (getmaxx(stdscr) - win_width) / 2;
-            y = (y >= 0) ? y : (getmaxy(stdscr) - (win_height / 2)) / 2;
-            y_offset_odd = y & 1;
+            x = (x >= 0) ? x : (getmaxx(stdscr) * cellW - win_width) / 2;
+            y = (y >= 0) ? y : (getmaxy(stdscr) - (win_height / cellH)) / 2;
+            if (renderMode != RenderMode::HalfBlock) {
+                // Only half blocks can start halfway into a character.
+                x -= x % cellW;
+                y -= y % cellH;
+            }
+            y_offset_odd = renderMode == RenderMode::HalfBlock && (y & 1);
             y_last_odd = (y + win_height) & 1;
-            win = newwin(win_height / 2 + (y_offset_odd | y_last_odd), win_width, y / 2, x);
+            win = newwin(cell_rows(), cell_columns(), y / cellH, x / cellW);
 
             if (win != NULL) 
             {                
                 nodelay(win, true);
                 keypad(win, true);                                
-                NEW_2D_ARRAY(back_buffer, Fragment, win_width, win_height);
+                back_buffer.Resize(win_width, win_height);
+                back_rgb.Resize(win_width, win_height);
+                tiles.Resize(win_width, win_height);
+                int rows = cell_rows(), columns = cell_columns();
+                resize_damage(rows);
                 Clear(COLOR_BLACK);                
+                for (int i = 0; i < 3; i++)
+                    frames[i].Resize(columns, rows);
+                presenter.Resize(columns, rows);
+                if (backend == Backend::Curses)
+                    output = std::make_unique<CursesBackend>(win, pairs, QuantizeLUT::For(paletteColors));
+                else {
+                    // ncurses still handles input, it must not repaint the window over our output.
+                    wrefresh(win);
+                    output = std::make_unique<AnsiBackend>(STDOUT_FILENO, getbegx(win), getbegy(win), getmaxx(stdscr), backend == Backend::AnsiTrueColor);
+                }
+                // Pairs of the basic colors are used by nearly everything, define them before the first frame.
+                pairs.Prewarm(std::min(COLORS, 16));
                 x_offset = x;
                 y_offset = y;
                 return true;
@@ -136,53 +233,374 @@ namespace cge
             else            
                 return win_width = win_height = y_offset_odd = y_last_odd = 0; // RETURN false            
         }        
-        // Sets frame cap. Default is 60 FPS
+        /*
+            Sets the engine up without a terminal. Frames are rendered into memory only,
+            Start() does not wait between them and they can be checksummed or dumped.
+            Width and height are in pixels.
+        */
+        bool ConstructHeadless(int width, int height)
+        {
+            if (terminal || width <= 0 || height <= 0) {
+                Errors.push_back("[ERROR] cge::CursesGameEngine::ConstructHeadless: Invalid dimensions or terminal already in use! Not constructed.");
+                return false;
+            }
+            headless = true;
+            pacer.SetMode(PacingMode::Uncapped);
+            win_width = width;
+            win_height = height;
+            y_offset_odd = false;
+            y_last_odd = height & 1;
+            back_buffer.Resize(win_width, win_height);
+            back_rgb.Resize(win_width, win_height);
+            tiles.Resize(win_width, win_height);
+            int rows = cell_rows(), columns = cell_columns();
+            resize_damage(rows);
+            Clear(COLOR_BLACK);
+            for (int i = 0; i < 3; i++)
+                frames[i].Resize(columns, rows);
+            presenter.Resize(columns, rows);
+            output = std::make_unique<HeadlessBackend>();
+            return true;
+        }
+        /*
+            Replaces the backend frames are sent to, call it after constructing and
+            before Start(). Lets a headless engine write escape sequences somewhere.
+        */
+        bool SetOutputBackend(std::unique_ptr<OutputBackend> backend)
+        {
+            if (!output || presenting || !backend) {
+                Errors.push_back("[ERROR] cge::CursesGameEngine::SetOutputBackend: Not constructed, already running or no backend! Backend not changed.");
+                return false;
+            }
+            output = std::move(backend);
+            presenter.Invalidate();
+            return true;
+        }
+        /*
+            Chooses how many pixels a character shows, call it before Construct() or
+            ConstructHeadless(). Width and height of the window are in pixels of the mode.
+        */
+        bool SetRenderMode(RenderMode mode)
+        {
+            if (win || headless) {
+                Errors.push_back("[ERROR] cge::CursesGameEngine::SetRenderMode: Already constructed! Mode not changed.");
+                return false;
+            }
+            renderMode = mode;
+            cellW = cge::CellWidth(mode);
+            cellH = cge::CellHeight(mode);
+            return true;
+        }
+        RenderMode GetRenderMode() const { return renderMode; }
+        // Makes Start() return after the given number of frames, 0 means no limit.
+        void SetFrameLimit(unsigned long frames)
+        {
+            frameLimit = frames;
+        }
+        /*
+            Passes the given delta to OnGameUpdate() instead of the measured frame time,
+            which makes runs reproducible. 0 goes back to measured time.
+        */
+        void SetFixedDelta(float seconds)
+        {
+            fixedDelta = seconds;
+        }
+        /*
+            In headless mode, writes every presented frame as a PPM image. The pattern
+            holds the frame number as one %lu, optionally zero padded, e.g.
+            "frame%05lu.ppm", and "%%" for a percent sign. Other patterns are refused.
+        */
+        bool SetFrameDump(const std::string& pattern)
+        {
+            if (!pattern.empty() && !valid_dump_pattern(pattern)) {
+                Errors.push_back("[ERROR] cge::CursesGameEngine::SetFrameDump: The pattern needs exactly one %lu and no other conversion.");
+                frameDumpPattern.clear();
+                return false;
+            }
+            frameDumpPattern = pattern;
+            return true;
+        }
+        // Sets frame cap. Default is 60 FPS, 0 removes the cap.
         void SetMaxFPS(int framesPerSec)
         {
-            msPerFrame = 1000.0f / framesPerSec;
+            pacer.SetTargetFPS(framesPerSec);
+        }
+        /*
+            In deferred mode the Draw* functions and Clear() are only recorded and get
+            rasterized after OnGameUpdate() by `threads` threads (0 = all cores), in
+            screen tiles. Overrides of Draw() are not called by the other primitives then.
+        */
+        void SetDeferredDrawing(bool on, unsigned threads = 0)
+        {
+            if (!on)
+                tiles.Flush(*target);
+            deferred = on;
+            tiles.SetThreads(threads);
+        }
+        /*
+            When on, Start() presents every frame on its own thread while the next one
+            is being updated. The update thread never waits for the terminal, if the
+            presenting falls behind the older of the waiting frames is dropped.
+            Has no effect in headless mode. Must be set before Start().
+        */
+        void SetPipelinedPresent(bool on)
+        {
+            pipelined = on;
+        }
+        /*
+            With damage tracking on, the engine remembers what was drawn where. Clear()
+            then only wipes what the last frames drew and only the changed cells are
+            resolved and compared for presenting, so a mostly static picture costs
+            next to nothing per frame. Drawing straight into back_buffer has to be
+            reported with Invalidate(). Display lists stay in the back buffer between
+            frames, what they leave behind is restored before anything goes over it.
+        */
+        void SetDamageTracking(bool on)
+        {
+            damageTracking = on;
+            clearValid = false;
+            damage.AddAll();
+            drawn.AddAll();
+        }
+        /*
+            When on, Start() reads input on its own thread, so keys and mouse events
+            get their timestamps when they arrive instead of when the frame starts.
+            They are still handed to the callbacks at the start of the next frame.
+            Needs a terminal, must be set before Start().
+        */
+        void SetInputThread(bool on)
+        {
+            threadedInput = on;
+        }
+        /* Frames that were never presented because a newer one was ready first. */
+        unsigned long GetDroppedPresents() const { return droppedPresents; }
+        void SetPacingMode(PacingMode mode)
+        {
+            pacer.SetMode(mode);
+        }
+        /* Frame time distribution of the recent frames and count of missed deadlines. */
+        FrameStats GetFrameStats() const
+        {
+            return pacer.Stats();
+        }
+        /*
+            Times the phases of every frame and counts pair lookups, terminal bytes
+            and resolved cells, see FrameProfiler. With the pipelined present the
+            presenting thread is not profiled, Present then is the hand over only.
+        */
+        void SetProfiling(bool on)
+        {
+            profiler.SetEnabled(on);
+        }
+        // Draws the averages of the last frames over the bottom of the window, turns profiling on.
+        void SetProfilerOverlay(bool on)
+        {
+            if (on && !profiler.Enabled())
+                profiler.SetEnabled(true);
+            profilerOverlay = on;
+        }
+        bool ProfilerOverlay() const { return profilerOverlay; }
+        /*
+            Writes every key and mouse event handed to the callbacks, with the frame
+            it came in, to a log at path until Start() returns. Call it after
+            constructing, the log notes the window size and render mode.
+        */
+        bool RecordInput(const std::string& path)
+        {
+            InputLogHeader header;
+            header.width = win_width;
+            header.height = win_height;
+            header.mode = renderMode;
+            if (!recorder.Open(path, header)) {
+                Errors.push_back("[ERROR] cge::CursesGameEngine::RecordInput: Could not create " + path);
+                return false;
+            }
+            return true;
+        }
+        /*
+            Feeds the events of a recorded log to the callbacks in the frames they were
+            recorded in, instead of reading the terminal, and makes Start() return
+            after as many frames as the recorded run had. Together with a fixed delta
+            (SetFixedDelta()) every replay of a log does the same work, headless it
+            runs as fast as it can. The window has to have the size and render mode
+            of the recording, see InputReplay::Header().
+        */
+        bool ReplayInput(InputReplay log)
+        {
+            const InputLogHeader& header = log.Header();
+            if (header.width != win_width || header.height != win_height || header.mode != renderMode) {
+                Errors.push_back("[ERROR] cge::CursesGameEngine::ReplayInput: The log was recorded with another window size or render mode.");
+                return false;
+            }
+            replay = std::move(log);
+            replaying = true;
+            return true;
+        }
+        /*
+            When the terminal cannot keep up with the output, frames are skipped while
+            OnGameUpdate() still runs every frame, then colors are reduced and then
+            the present rate, see OutputLevel. On by default, it never kicks in
+            headless. Set before Start().
+        */
+        void SetOutputBackpressure(bool on, const OutputLimits& limits = OutputLimits())
+        {
+            backpressure = on;
+            outputMonitor.SetLimits(limits);
+            outputMonitor.Reset();
+            outputLevel = OutputLevel::Normal;
         }
+        OutputLevel GetOutputLevel() const { return outputLevel; }
+        // Frames not presented because the terminal was behind.
+        unsigned long GetSkippedPresents() const { return skippedPresents; }
+        FrameProfiler& GetProfiler() { return profiler; }
+        const FrameProfiler& GetProfiler() const { return profiler; }
         void Start()
         {
             if (!OnGameStart())
                 return;
 
             bool run = true;
-            std::chrono::_V2::system_clock::time_point before = Time::now(), after;
-            std::chrono::duration<float, std::milli> fsec;
             float delta = 0;
+            bool threaded = pipelined && !headless;
+            if (threaded) {
+                presenting = true;
+                presentThread = std::thread(&CursesGameEngine::present_loop, this);
+            }
+            if (threadedInput && win) {
+                reading = true;
+                inputThread = std::thread(&CursesGameEngine::input_loop, this);
+            }
+            pacer.Start();
             while (run)
             {
-                handle_input();
-                run = OnGameUpdate(delta);                
-                draw_back_buffer();
-                draw_strings();                
-                wrefresh(win);
-
-                after = Time::now();
-                fsec = after - before;
+                profiler.BeginFrame(frameCount + 1);
+                {
+                    CGE_PROFILE_PHASE(profiler, ProfilePhase::Input);
+                    handle_input();
+                }
+                {
+                    CGE_PROFILE_PHASE(profiler, ProfilePhase::Update);
+                    run = OnGameUpdate(delta);
+                }
+                if (profilerOverlay)
+                    draw_profile_overlay();
+                {
+                    CGE_PROFILE_PHASE(profiler, ProfilePhase::Rasterize);
+                    tiles.Flush(*target);
+                }
+                {
+                    CGE_PROFILE_PHASE(profiler, ProfilePhase::Resolve);
+                    draw_back_buffer();
+                }
+                if (profiler.Enabled())
+                    profiler.Count(ProfileCounter::CellsResolved, cell_count(frameCells));
+                {
+                    CGE_PROFILE_PHASE(profiler, ProfilePhase::Text);
+                    draw_strings();
+                }
+                {
+                    CGE_PROFILE_PHASE(profiler, ProfilePhase::Present);
+                    if (threaded)
+                        publish_frame();
+                    else if (should_present())
+                        profiled_present();
+                    else {
+                        skippedPresents++;
+                        presentAll = true;
+                    }
+                }
+                if (outputLevel != reportedLevel) {
+                    reportedLevel = outputLevel;
+                    OnOutputDegraded(reportedLevel);
+                }
+                finish_damage();
+                frameCount++;
+                if (headless)
+                    record_headless_frame();
+                if (frameLimit && frameCount >= frameLimit)
+                    run = false;
+                if (replaying && replay.Finished(frameCount))
+                    run = false;
 
-                if (fsec.count() < msPerFrame)
                 {
-                    std::chrono::duration<float, std::milli> delta_ms(msPerFrame - fsec.count());
-                    auto delta_ms_duration = std::chrono::duration_cast<std::chrono::milliseconds>(delta_ms);
-                    std::this_thread::sleep_for(std::chrono::milliseconds(delta_ms_duration.count()));
+                    CGE_PROFILE_PHASE(profiler, ProfilePhase::Wait);
+                    delta = pacer.EndFrame();
                 }
-                
-                before = Time::now();
-                std::chrono::duration<float, std::milli> sleep_time = before - after;                           
-                delta = (fsec + sleep_time).count() / 1000.0f;
+                if (fixedDelta > 0.0f)
+                    delta = fixedDelta;
 
                 timeFromStart += delta;
+                profiler.EndFrame();
+            }
+            if (threaded) {
+                presenting = false;
+                frameReady.notify_one();
+                presentThread.join();
             }
+            if (inputThread.joinable()) {
+                reading = false;
+                inputThread.join();
+            }
+            if (recorder.IsOpen() && !recorder.Close(frameCount))
+                Errors.push_back("[ERROR] cge::CursesGameEngine: Could not write the input log.");
         }
-        int StdWinWidth() { return getmaxx(stdscr); }
-        int StdWinHeight() { return getmaxy(stdscr) * 2; }        
+        /* Hash of everything that is on screen after the last presented frame. */
+        uint64_t FrameChecksum() const
+        {
+            // FNV-1a over the presented cells.
+            uint64_t h = 0xcbf29ce484222325ULL;
+            const CellBuffer& screen = presenter.Front();
+            for (int y = 0; y < screen.Height(); y++)
+                for (int x = 0; x < screen.Width(); x++)
+                {
+                    const Cell& c = screen.At(x, y);
+                    uint64_t v = (uint64_t)(uint32_t)c.ch << 16 | (c.f & 0xFF) << 8 | (c.b & 0xFF);
+                    for (int i = 0; i < 6; i++, v >>= 8)
+                        h = (h ^ (v & 0xFF)) * 0x100000001b3ULL;
+                    // The rest of RGB colors, cells in palette colors hash as they always did.
+                    if ((c.f | c.b) > 0xFF) {
+                        v = (uint64_t)(c.f >> 8) << 24 | c.b >> 8;
+                        for (int i = 0; i < 6; i++, v >>= 8)
+                            h = (h ^ (v & 0xFF)) * 0x100000001b3ULL;
+                    }
+                }
+            return h;
+        }
+        /* Checksums of all frames presented so far in headless mode. */
+        const std::vector<uint64_t>& FrameChecksums() const { return frameChecksums; }
+        unsigned long GetFrameCount() const { return frameCount; }
+        /* Writes the back buffer as a binary PPM image, text is not included. */
+        bool DumpFramePPM(const std::string& path) const
+        {
+            FILE* f = fopen(path.c_str(), "wb");
+            if (!f)
+                return false;
+            fprintf(f, "P6\n%d %d\n255\n", win_width, win_height);
+            std::vector<unsigned char> line(win_width * 3);
+            for (int y = 0; y < win_height; y++)
+            {
+                const Fragment* row = back_buffer.Row(y);
+                for (int x = 0; x < win_width; x++)
+                {
+                    uint32_t rgb = row[x].rgb ? back_rgb(x, y) & 0xFFFFFF : PaletteRGB(row[x].GetColor());
+                    line[x * 3 + 0] = rgb >> 16;
+                    line[x * 3 + 1] = rgb >> 8 & 0xFF;
+                    line[x * 3 + 2] = rgb & 0xFF;
+                }
+                fwrite(line.data(), 1, line.size(), f);
+            }
+            return fclose(f) == 0;
+        }
+        int StdWinWidth() { return getmaxx(stdscr) * cellW; }
+        int StdWinHeight() { return getmaxy(stdscr) * cellH; }        
  
     protected:
         virtual bool OnGameStart() { return false; }
         virtual bool OnGameUpdate(float delta) { return false; }
         virtual void OnMouseEvent(int x, int y,  mmask_t bstate) {}
         virtual void OnKeyPressed(int key) {}
+        // The terminal fell behind or caught up again and output was cut back to level, see SetOutputBackpressure().
+        virtual void OnOutputDegraded(OutputLevel /*level*/) {}
 
         /*
             Draw functions 
@@ -190,261 +608,1016 @@ namespace cge
         // Draw a single pixel
         virtual void Draw(int x, int y, uint8_t fColor) 
         {
+            if (deferred) {
+                tiles.Add(DrawCommand::Pixel(x, y, fColor));
+                damaged(x, y, x, y);
+                return;
+            }
             if (!inRange(0, win_width - 1, x) || !inRange(0, win_height - 1, y))
                 return;
+            damaged(x, y, x, y);
 
-            back_buffer[x][y].state = true;
-            back_buffer[x][y].f = fColor;
+            Fragment& frag = (*target)(x, y);
+            frag.state = true;
+            frag.rgb = false;
+            frag.f = fColor;
         }
-        void DrawString(int x, int y, std::wstring str, uint8_t fColor, bool alpha = false, Align alignment = Align::Left)
+        /*
+            Draws text over the pixels, y is in pixels and is rounded down to a character row.
+            With alpha, spaces leave what is under them visible. The string is copied, so
+            it does not have to outlive the call.
+        */
+        void DrawString(int x, int y, std::wstring_view str, uint8_t fColor, bool alpha = false, Align alignment = Align::Left)
         {
-            cge_string s;
-            s.str = str;
-            s.alpha = alpha;
-            s.f = fColor;
-
-            switch(alignment) {
-                case Align::Left: break;
-                case Align::Center: x -= str.length() / 2; break;
-                case Align::Right:  x -= str.length(); break;
-            }            
-            s.x = std::clamp(x, 0, win_width);
-            s.y = y / 2;
-
-            strQueue.push(s);        
+            TextRun run;
+            wchar_t* dst = text.Allocate(str.length(), run.offset);
+            if (!dst)
+                return;
+            std::copy(str.begin(), str.end(), dst);
+            submit_text(run, str.length(), x, y, fColor, alpha, alignment);
         }
-        void DrawString(int x, int y, std::string str, uint8_t fColor, bool alpha = false, Align alignment = Align::Left) {
-            DrawString(x, y, std::wstring(str.begin(), str.end()), fColor, alpha, alignment);
+        // UTF-8 version.
+        void DrawString(int x, int y, std::string_view str, uint8_t fColor, bool alpha = false, Align alignment = Align::Left)
+        {
+            TextRun run;
+            wchar_t* dst = text.Allocate(str.length(), run.offset);
+            if (!dst)
+                return;
+            size_t length = DecodeUTF8(str.data(), str.length(), dst);
+            text.Shrink(run.offset, str.length(), length);
+            submit_text(run, length, x, y, fColor, alpha, alignment);
         }
         void DrawLine(int x0, int y0, int x1, int y1, uint8_t color)
         {
-            /* Use of Bresenham's line algorithm. */
-            int dx = std::abs(x1 - x0);
-            int sx = x0 < x1 ? 1 : -1;
-            int dy = -abs(y1 - y0);
-            int sy = y0 < y1 ? 1 : -1;
-            int err = dx + dy;
-
-            while (true)
+            DrawCommand c = DrawCommand::Line(x0, y0, x1, y1, color);
+            damaged(c);
+            if (deferred)
+                tiles.Add(c);
+            else
+                LinePixels(x0, y0, x1, y1, [&](int x, int y) { Draw(x, y, color); });
+        }
+        void DrawCircle(int center_x, int center_y, int r, uint8_t color) 
+        {
+            DrawCommand c = DrawCommand::Circle(center_x, center_y, r, color);
+            damaged(c);
+            if (deferred)
+                tiles.Add(c);
+            else
+                CirclePixels(center_x, center_y, r, [&](int x, int y) { Draw(x, y, color); });
+        }
+        // Two corners
+        void DrawRectangle(int x0, int y0, int x1, int y1, uint8_t color)
+        {
+            DrawCommand c = DrawCommand::Rectangle(x0, y0, x1, y1, color);
+            damaged(c);
+            if (deferred)
+                tiles.Add(c);
+            else
+                RectanglePixels(x0, y0, x1, y1, [&](int x, int y) { Draw(x, y, color); });
+        }
+        // Two corners, both inclusive.
+        void FillRectangle(int x0, int y0, int x1, int y1, uint8_t color)
+        {
+            DrawCommand c = DrawCommand::Rectangle(x0, y0, x1, y1, color, true);
+            damaged(c);
+            if (deferred)
+                tiles.Add(c);
+            else
+                FillRectangleSpans(x0, y0, x1, y1, [&](int a, int b, int y) { fill_span(a, b, y, color); }, 0, win_height - 1);
+        }
+        // Circle sector, angles in radians from the +x axis, clockwise on screen.
+        void FillPie(int center_x, int center_y, int r, float startAngle, float endAngle, uint8_t color)
+        {
+            DrawCommand c = DrawCommand::Pie(center_x, center_y, r, startAngle, endAngle, color);
+            damaged(c);
+            if (deferred)
+                tiles.Add(c);
+            else
+                FillPieSpans(center_x, center_y, r, startAngle, endAngle, [&](int a, int b, int y) { fill_span(a, b, y, color); }, 0, win_height - 1);
+        }
+        void FillCircle(int center_x, int center_y, int r, uint8_t color)
+        {
+            DrawCommand c = DrawCommand::Circle(center_x, center_y, r, color, true);
+            damaged(c);
+            if (deferred)
+                tiles.Add(c);
+            else
+                FillCircleSpans(center_x, center_y, r, [&](int a, int b, int y) { fill_span(a, b, y, color); }, 0, win_height - 1);
+        }
+        /*
+            Transforms the points and connects them with lines, back to the first one
+            if closed. Points are transformed a chunk at a time right before their
+            lines are drawn, without a transformed copy of the whole set. Like the
+            fills it writes pixels without going through Draw().
+        */
+        void DrawPolyline(const Points2f& points, const Affine2f& transform, uint8_t color, bool closed = false)
+        {
+            static constexpr size_t CHUNK = 256;
+            const size_t n = points.Size();
+            if (n == 0)
+                return;
+            float xs[CHUNK], ys[CHUNK];
+            int px[CHUNK + 1], py[CHUNK + 1];  // [0] is the last point of the previous chunk
+            int firstX = 0, firstY = 0;
+            for (size_t start = 0; start < n; start += CHUNK)
             {
-                Draw(x0, y0, color);
-                if (x0 == x1 && y0 == y1) break;
-                int e2 = 2 * err;
-                if (e2 >= dy) {
-                    err += dy;
-                    x0 += sx;
+                const size_t count = std::min(CHUNK, n - start);
+                TransformPoints(transform, points.x.data() + start, points.y.data() + start, xs, ys, count);
+                int x0 = INT32_MAX, y0 = INT32_MAX, x1 = INT32_MIN, y1 = INT32_MIN;
+                for (size_t i = 0; i < count; i++)
+                {
+                    px[i + 1] = to_pixel(xs[i]);
+                    py[i + 1] = to_pixel(ys[i]);
+                    x0 = std::min(x0, px[i + 1]);
+                    y0 = std::min(y0, py[i + 1]);
+                    x1 = std::max(x1, px[i + 1]);
+                    y1 = std::max(y1, py[i + 1]);
                 }
-                if (e2 <= dx) {
-                    err += dx;
-                    y0 += sy;
+                if (start == 0) {
+                    px[0] = firstX = px[1];
+                    py[0] = firstY = py[1];
                 }
+                damaged(std::min(x0, px[0]), std::min(y0, py[0]), std::max(x1, px[0]), std::max(y1, py[0]));
+                for (size_t i = 0; i < count; i++)
+                    if (start + i > 0)
+                        polyline_segment(px[i], py[i], px[i + 1], py[i + 1], color);
+                px[0] = px[count];
+                py[0] = py[count];
+            }
+            if (closed && n > 2) {
+                damaged(std::min(px[0], firstX), std::min(py[0], firstY), std::max(px[0], firstX), std::max(py[0], firstY));
+                polyline_segment(px[0], py[0], firstX, firstY, color);
             }
-
         }
-        void DrawCircle(int center_x, int center_y, int r, uint8_t color) 
+        /*
+            Draws a sprite with its top left corner at x, y, every sprite pixel as a
+            scale x scale block. Pixels equal to the sprite's key are skipped.
+        */
+        void DrawSprite(const SpriteView& sprite, int x, int y, SpriteFlip flip = SpriteFlip::None, int scale = 1)
+        {
+            // Sprites are blitted right away, earlier deferred commands go first.
+            tiles.Flush(*target);
+            damaged(x, y, x + sprite.width * scale - 1, y + sprite.height * scale - 1);
+            BlitSprite(*target, sprite, x, y, flip, scale, 0, 0, win_width - 1, win_height - 1);
+        }
+        /*
+            Draws an RGB picture with its top left corner at x, y. Transparent pixels
+            are skipped. The back buffer keeps the colors as they are, terminals
+            without RGB get the nearest of their colors when the frame is sent.
+            Layers only hold palette colors, there the picture is quantized right
+            away. Dither spreads the error of the nearest colors into an ordered
+            pattern, which keeps gradients like heatmaps from banding.
+        */
+        void DrawRGB(const RGBFramebuffer& image, int x, int y, bool dither = false)
         {
-            /* Use of Bresenham's circle algorithm. */
-            int x = 0, y = r;
-            int d = 3 - 2 * r;
-            drawCircle_8p(center_x, center_y, x, y, color);
-            while (y >= x)
+            // Drawn right away, earlier deferred commands go first.
+            tiles.Flush(*target);
+            int x0 = std::max(x, 0), y0 = std::max(y, 0);
+            int x1 = std::min(x + image.Width(), win_width) - 1, y1 = std::min(y + image.Height(), win_height) - 1;
+            if (x0 > x1 || y0 > y1)
+                return;
+            damaged(x0, y0, x1, y1);
+            if (targetLayer)
             {
-                x++;
-                if (d > 0) {
-                    y--;
-                    d = d + 4 * (x - y) + 10;
-                }
-                else
-                    d = d + 4 * x + 6;
-                drawCircle_8p(center_x, center_y, x, y, color);                
+                const QuantizeLUT& lut = QuantizeLUT::For(paletteColors);
+                for (int row = y0; row <= y1; row++)
+                    QuantizeRow(image.Span(x0 - x, row - y), target->Span(x0, row), (size_t)(x1 - x0 + 1), x0, row, lut, dither);
+                return;
+            }
+            const DamageRect r{ x0, y0, x1, y1 };
+            rgbBounds = rgbBounds.x0 > rgbBounds.x1 ? r : rgbBounds.Union(r);
+            const uint32_t flags = CELL_RGB | (dither ? CELL_DITHER : 0);
+            for (int row = y0; row <= y1; row++)
+            {
+                const uint32_t* src = image.Span(x0 - x, row - y);
+                Fragment* dst = back_buffer.Span(x0, row);
+                uint32_t* colors = back_rgb.Span(x0, row);
+                for (int i = 0; i <= x1 - x0; i++)
+                    if (src[i] >> 24) {
+                        dst[i] = Fragment{ 0, 0, true, true };
+                        colors[i] = flags | (src[i] & 0xFFFFFF);
+                    }
             }
         }
-        // Two corners
-        void DrawRectangle(int x0, int y0, int x1, int y1, uint8_t color) {
-            int x, y;
-            int xi = (x1 - x0) > 0 ? 1 : -1;
-            int yi = (y1 - y0) > 0 ? 1 : -1;
-            
-            for (x = x0; x != x1 + xi; x += xi) {
-                Draw(x, y0, color);
-                Draw(x, y1, color);
-            }
-            for (y = y0; y != y1 + yi; y += yi) {
-                Draw(x0, y, color);
-                Draw(x1, y, color);
-            }
-        }
-        void FillRectangle(int x0, int y0, int x1, int y1, uint8_t bColor) {}
-        void FillPie(int x, int y, float angle, uint8_t bColor) {}
-        void FillCircle(int center_x, int center_y, int r, uint8_t color)
+        /*
+            Draws the cached layer of a retained display list over what has been drawn
+            so far this frame. Only primitives changed since the last call are rasterized.
+            Drawn into a layer (see SetDrawTarget()) it only touches what changed since
+            the last call, so there it should be the only thing in the layer.
+        */
+        void DrawDisplayList(DisplayList& list)
         {
-            /* Use of Bresenham's circle algorithm. */
-            int x = 0, y = r;
-            int d = 3 - 2 * r;
-            fillCircle_8p(center_x, center_y, x, y, color);
-            while (y >= x)
+            // The layer lands in the target right away, earlier deferred commands go first.
+            tiles.Flush(*target);
+            list.Update(win_width, win_height);
+            int x0, y0, x1, y1;
+            if (targetLayer)
             {
-                x++;
-                if (d > 0) {
-                    y--;
-                    d = d + 4 * (x - y) + 10;
+                // Pixels the list no longer covers become transparent.
+                const Fragment transparent{ 0, 0, false };
+                for (const DamageRect& r : list.Changes().Rects()) {
+                    composite(list.Layer(), r, &transparent);
+                    targetLayer->MarkDrawn(r.x0, r.y0, r.x1, r.y1);
                 }
-                else
-                    d = d + 4 * x + 6;
-                fillCircle_8p(center_x, center_y, x, y, color);                
+                list.ForgetChanges();
+                return;
+            }
+            if (!damageTracking)
+            {
+                list.ForgetChanges();
+                if (list.UsedBounds(x0, y0, x1, y1))
+                    composite(list.Layer(), DamageRect{ x0, y0, x1, y1 }, nullptr);
+                return;
+            }
+            if (list.owner == 0 || list.owner > listFrames.size()) {
+                listFrames.push_back(0);
+                list.owner = (uint32_t)listFrames.size();
             }
+            // Where the layer changed, pixels it no longer covers are restored if it left them
+            // there, what was drawn over them this frame stays. The same goes for pixels of lists
+            // drawn later, they go over them again below.
+            for (const DamageRect& r : list.Changes().Rects())
+            {
+                bool restored = composite_list(list.Layer(), r, list.owner, true);
+                damage.Add(r);
+                // Otherwise what the list left behind stays until the next Clear().
+                if (!clearedThisFrame || restored)
+                    drawn.Add(r);
+            }
+            list.ForgetChanges();
+            listFrames[list.owner - 1] = frameCount + 1;
+            frameLists.push_back(&list);
+            // The list goes over whatever was wiped or drawn since it was last composited.
+            if (!list.UsedBounds(x0, y0, x1, y1))
+                return;
+            for (const DamageRegion* region : { &cleared, &prevDrawn, &drawn })
+                for (const DamageRect& r : region->Rects())
+                {
+                    DamageRect c{ std::max(r.x0, x0), std::max(r.y0, y0), std::min(r.x1, x1), std::min(r.y1, y1) };
+                    if (c.x0 <= c.x1 && c.y0 <= c.y1) {
+                        composite_list(list.Layer(), c, list.owner, false);
+                        damage.Add(c);
+                    }
+                }
+        }
+        /*
+            Makes the Draw* functions, Clear(), DrawSprite() and DrawDisplayList() draw
+            into a layer of stack until ResetDrawTarget(), what they touch gets
+            composed again by the next DrawLayers(). The stack is sized to the window.
+        */
+        void SetDrawTarget(LayerStack& stack, size_t layer)
+        {
+            tiles.Flush(*target);
+            stack.Resize(win_width, win_height);
+            targetLayer = &stack[layer];
+            target = &targetLayer->pixels;
+        }
+        void ResetDrawTarget()
+        {
+            tiles.Flush(*target);
+            targetLayer = nullptr;
+            target = &back_buffer;
+        }
+        /*
+            Replaces the back buffer with the composite of stack, like Clear() does with
+            a color, so it goes first in a frame. Only layers that changed are merged
+            again, and with damage tracking only what changed or was drawn over since
+            the last call is copied.
+        */
+        void DrawLayers(LayerStack& stack)
+        {
+            tiles.Flush(*target);
+            stack.Resize(win_width, win_height);
+            const DamageRegion& changed = stack.Update();
+            if (!damageTracking) {
+                if (win_width > 0 && win_height > 0)
+                    stack.CopyTo(back_buffer, DamageRect{ 0, 0, win_width - 1, win_height - 1 });
+                return;
+            }
+            // Drawing over the composite lasts until this is called again.
+            prevDrawn.Add(drawn);
+            prevDrawn.Add(cleared);
+            prevDrawn.Add(changed);
+            for (const DamageRect& r : prevDrawn.Rects()) {
+                stack.CopyTo(back_buffer, r);
+                forget_list_pixels(r);
+            }
+            damage.Add(prevDrawn);
+            cleared.Add(prevDrawn);
+            prevDrawn.Clear();
+            drawn.Clear();
+            // The back buffer no longer has one color to clear back to.
+            clearValid = false;
+            clearedThisFrame = false;
+            frameLists.clear();
         }
         /*
             State setting functions
         */
         void SetCursorState(bool on)
         {
-            curs_set(on);
+            if (terminal)
+                curs_set(on);
         }
+        /*
+            Fills the back buffer with color. On a layer it makes what was drawn
+            there since the last Clear() transparent instead, color is not used.
+        */
         void Clear(uint8_t color)
         {
-            for (int x = 0; x < win_width; x++)
-                for (int y = 0; y < win_height; y++)
+            if (targetLayer)
+            {
+                if (!deferred) {
+                    targetLayer->Clear();
+                    return;
+                }
+                for (const DamageRect& r : targetLayer->drawn.Rects())
+                    tiles.Add(DrawCommand::Clear(r.x0, r.y0, r.x1, r.y1, 0));
+                targetLayer->dirty.Add(targetLayer->drawn);
+                targetLayer->drawn.Clear();
+                return;
+            }
+            clearedThisFrame = true;
+            frameLists.clear();
+            if (damageTracking && clearValid && color == clearColor)
+            {
+                // Everything else already has the color.
+                prevDrawn.Add(drawn);
+                for (const DamageRect& r : prevDrawn.Rects())
                 {
-                    back_buffer[x][y].b = back_buffer[x][y].f = color;
-                    back_buffer[x][y].state = false;
+                    if (deferred)
+                        tiles.Add(DrawCommand::Clear(r.x0, r.y0, r.x1, r.y1, color));
+                    else
+                        for (int y = r.y0; y <= r.y1; y++)
+                            FillSpan(*target, r.x0, r.x1 + 1, y, Fragment{ color, color, false });
+                    forget_list_pixels(r);
                 }
+                cleared.Add(prevDrawn);
+                damage.Add(prevDrawn);
+                prevDrawn.Clear();
+                drawn.Clear();
+                return;
+            }
+            if (deferred)
+                tiles.Clear(color);
+            else
+                FillAll(*target, Fragment{ color, color, false });
+            rgbBounds = DamageRect{ 0, 0, -1, -1 };
+            clearValid = true;
+            clearColor = color;
+            forget_list_pixels();
+            if (damageTracking) {
+                cleared.AddAll();
+                damage.AddAll();
+                prevDrawn.Clear();
+                drawn.Clear();
+            }
+        }
+        /*
+            Marks pixels as changed, needed with damage tracking after writing to
+            back_buffer directly. Corners are inclusive.
+        */
+        void Invalidate(int x0, int y0, int x1, int y1)
+        {
+            forget_list_pixels(DamageRect{ x0, y0, x1, y1 });
+            damaged(x0, y0, x1, y1);
+        }
+        void Invalidate()
+        {
+            forget_list_pixels();
+            damage.AddAll();
+            drawn.AddAll();
         }
         void ClearStd(uint8_t color)
         {
+            outColor = color;
+            // Shows in the cells that reach past the window.
+            damage.AddAll();
+            if (!terminal)
+                return;
+            std::lock_guard<std::mutex> lock(cursesMutex);
             cchar_t c;
-            setcchar(&c, L" ", WA_NORMAL, get_pair(COLOR_BLACK, color), NULL);
+            int pair = get_pair(COLOR_BLACK, color);
+            setcchar(&c, L" ", WA_NORMAL, 0, &pair);
             bkgrnd(&c);
-            outColor = color;
             refresh();
+            // stdscr was just repainted over our window, so nothing on screen can be trusted.
+            presenter.Invalidate();
+            if (output)
+                output->Invalidate();
         }
         /*
             State getting functions
         */
         int WinWidth() { return win_width; }        
         int WinHeight() {return win_height; }
+        // Pixels in one character, text goes to multiples of these.
+        int CellWidth() const { return cellW; }
+        int CellHeight() const { return cellH; }
+        /* Keys and mouse events handed to the callbacks this frame, in the order they came. */
+        const std::vector<InputEvent>& GetInputEvents() const { return frameInput; }
         /* Returs time elapsed after calling Start() in seconds. */
         float GetTime() { return timeFromStart; }
         /* Gets one character from stdin. */
-        int GetChar() { return wgetch(win); } 
+        int GetChar()
+        {
+            if (!win)
+                return ERR;
+            std::lock_guard<std::mutex> lock(cursesMutex);
+            return wgetch(win);
+        }
+        /* Hit, miss and eviction counts of the color pair cache. */
+        const ColorPairStats& GetColorPairStats() { return pairs.Stats(); }
     private:
-        uint16_t get_pair(const uint8_t& fore, const uint8_t& back)
+        void init_terminal()
         {
-            static uint16_t pair;
-            pair = fore * 256 + back + 1;
+            if (terminal)
+                return;
+            terminal = true;
+            initscr();
+            if (has_colors())
+                start_color();
+            cbreak();
+            mousemask(ALL_MOUSE_EVENTS | REPORT_MOUSE_POSITION, NULL);    
+            printf("\033[?1003h\n"); // Makes the terminal report mouse movement events
+            mouseinterval(0);
+            curs_set(false);            
 
-            // Define pair only if it isn't already defined.
-            if (!pair_defined[pair])
+            pairs.Reset(COLOR_PAIRS);
+        }
+        // The pattern is passed to snprintf(), so it may hold nothing but the frame number.
+        static bool valid_dump_pattern(const std::string& pattern)
+        {
+            int numbers = 0;
+            for (size_t i = 0; i < pattern.size(); i++)
             {
-                init_extended_pair(pair, fore, back);
-                pair_defined[pair] = true;
+                if (pattern[i] != '%')
+                    continue;
+                if (++i < pattern.size() && pattern[i] == '%')
+                    continue;
+                if (i < pattern.size() && pattern[i] == '0')
+                    i++;
+                while (i < pattern.size() && isdigit((unsigned char)pattern[i]))
+                    i++;
+                if (pattern.compare(i, 2, "lu") != 0)
+                    return false;
+                i++;
+                numbers++;
             }
-            return pair;                        
+            return numbers == 1;
         }
-        void draw_back_buffer()
+        void record_headless_frame()
+        {
+            frameChecksums.push_back(FrameChecksum());
+            if (!frameDumpPattern.empty())
+            {
+                char path[4096];
+                snprintf(path, sizeof(path), frameDumpPattern.c_str(), frameCount);
+                if (!DumpFramePPM(path))
+                    Errors.push_back("[ERROR] cge::CursesGameEngine: Could not write frame dump " + std::string(path));
+            }
+        }
+        int get_pair(uint8_t fore, uint8_t back)
+        {
+            return pairs.Get(fore, back);
+        }
+        // Cell color of pixel y in column x, pixels outside of the window take outColor.
+        uint32_t pixel_color(int x, int y)
+        {
+            if (!inRange(0, win_height - 1, y))
+                return outColor;
+            const Fragment& p = back_buffer(x, y);
+            return p.rgb ? back_rgb(x, y) : p.GetColor();
+        }
+        // Size of the window in characters.
+        int cell_columns() const { return (win_width + cellW - 1) / cellW; }
+        int cell_rows() const { return (win_height + (y_offset_odd ? 1 : 0) + cellH - 1) / cellH; }
+        void resize_damage(int rows)
+        {
+            for (DamageRegion* r : { &damage, &drawn, &prevDrawn, &cleared })
+                r->Resize(win_width, win_height);
+            const int columns = cell_columns();
+            frameCells.Resize(columns, rows);
+            textCells.Resize(columns, rows);
+            for (int i = 0; i < DAMAGE_HISTORY; i++) {
+                cellHistory[i].Resize(columns, rows);
+                textHistory[i].Resize(columns, rows);
+            }
+            for (unsigned long& f : bufferFrame)
+                f = 0;
+            damage.AddAll();
+            listPixels.Resize(win_width, win_height);
+            listPixels.Fill(0);
+            listBounds = DamageRect{ 0, 0, -1, -1 };
+        }
+        void damaged(int x0, int y0, int x1, int y1)
+        {
+            if (targetLayer) {
+                targetLayer->MarkDrawn(x0, y0, x1, y1);
+                return;
+            }
+            if (!damageTracking)
+                return;
+            release_list_pixels(DamageRect{ x0, y0, x1, y1 });
+            damage.Add(x0, y0, x1, y1);
+            drawn.Add(x0, y0, x1, y1);
+        }
+        void damaged(const DrawCommand& c) { damaged(c.left, c.top, c.right, c.bottom); }
+        bool clip_to_list_bounds(DamageRect& r) const
+        {
+            r.x0 = std::max(r.x0, listBounds.x0);
+            r.y0 = std::max(r.y0, listBounds.y0);
+            r.x1 = std::min(r.x1, listBounds.x1);
+            r.y1 = std::min(r.y1, listBounds.y1);
+            return r.x0 <= r.x1 && r.y0 <= r.y1;
+        }
+        bool stale_list_pixel(uint32_t owner) const { return owner && listFrames[owner - 1] != frameCount + 1; }
+        /*
+            What a pixel left by a list not drawn yet this frame would be now: the clear color, or
+            the pixel itself without a Clear() this frame, with the lists drawn so far over it.
+            Nothing else was drawn over it, or it would not be left.
+        */
+        void restore_list_pixel(int x, int y, Fragment& dst, uint32_t& owner) const
+        {
+            if (clearedThisFrame)
+                dst = Fragment{ clearColor, clearColor, false };
+            owner = 0;
+            for (const DisplayList* list : frameLists)
+            {
+                const Fragment& src = list->Layer()(x, y);
+                if (src.state) {
+                    dst.state = true;
+                    dst.rgb = false;
+                    dst.f = src.f;
+                    owner = list->owner;
+                }
+            }
+        }
+        /*
+            Called before something is drawn over r. Pixels left there by display lists that
+            were not drawn yet this frame are restored, without damage tracking the lists would
+            only go over what is drawn now later on.
+        */
+        void release_list_pixels(DamageRect r)
+        {
+            if (!clip_to_list_bounds(r))
+                return;
+            for (int y = r.y0; y <= r.y1; y++)
+            {
+                uint32_t* owner = listPixels.Span(r.x0, y);
+                Fragment* dst = back_buffer.Span(r.x0, y);
+                for (int i = 0; i <= r.x1 - r.x0; i++)
+                    if (stale_list_pixel(owner[i]))
+                        restore_list_pixel(r.x0 + i, y, dst[i], owner[i]);
+            }
+        }
+        // The pixels of r no longer come from a display list.
+        void forget_list_pixels(DamageRect r)
+        {
+            if (!clip_to_list_bounds(r))
+                return;
+            for (int y = r.y0; y <= r.y1; y++)
+                listPixels.FillSpan(r.x0, r.x1 + 1, y, 0);
+        }
+        void forget_list_pixels()
+        {
+            forget_list_pixels(listBounds);
+            listBounds = DamageRect{ 0, 0, -1, -1 };
+        }
+        // Copies the pixels r of layer covers into the target, with reset the others are set to it.
+        void composite(const Framebuffer& layer, DamageRect r, const Fragment* reset)
+        {
+            r.x0 = std::max(r.x0, 0);
+            r.y0 = std::max(r.y0, 0);
+            r.x1 = std::min(r.x1, win_width - 1);
+            r.y1 = std::min(r.y1, win_height - 1);
+            for (int y = r.y0; y <= r.y1; y++)
+            {
+                const Fragment* src = layer.Span(r.x0, y);
+                Fragment* dst = target->Span(r.x0, y);
+                for (int i = 0; i <= r.x1 - r.x0; i++)
+                    if (src[i].state) {
+                        dst[i].state = true;
+                        dst[i].rgb = false;
+                        dst[i].f = src[i].f;
+                    }
+                    else if (reset)
+                        dst[i] = *reset;
+            }
+        }
+        /*
+            composite() of a display list's layer into the back buffer, the pixels the layer covers
+            are recorded as coming from owner. With restore the pixels it does not cover that lists
+            not drawn yet this frame left behind are restored. Returns true if it touched pixels
+            of other lists not drawn yet, they have to go over them again.
+        */
+        bool composite_list(const Framebuffer& layer, DamageRect r, uint32_t owner, bool restore)
+        {
+            r.x0 = std::max(r.x0, 0);
+            r.y0 = std::max(r.y0, 0);
+            r.x1 = std::min(r.x1, win_width - 1);
+            r.y1 = std::min(r.y1, win_height - 1);
+            if (r.x0 > r.x1 || r.y0 > r.y1)
+                return false;
+            listBounds = listBounds.x0 > listBounds.x1 ? r : listBounds.Union(r);
+            bool restored = false;
+            for (int y = r.y0; y <= r.y1; y++)
+            {
+                const Fragment* src = layer.Span(r.x0, y);
+                Fragment* dst = back_buffer.Span(r.x0, y);
+                uint32_t* from = listPixels.Span(r.x0, y);
+                for (int i = 0; i <= r.x1 - r.x0; i++)
+                    if (src[i].state) {
+                        restored |= from[i] != owner && stale_list_pixel(from[i]);
+                        dst[i].state = true;
+                        dst[i].rgb = false;
+                        dst[i].f = src[i].f;
+                        from[i] = owner;
+                    }
+                    else if (restore && stale_list_pixel(from[i])) {
+                        restore_list_pixel(r.x0 + i, y, dst[i], from[i]);
+                        restored = true;
+                    }
+            }
+            return restored;
+        }
+        // Cells x0..x1 of rows row0..row1 from the back buffer.
+        void resolve_cells(CellBuffer& cells, int row0, int row1, int x0, int x1)
         {
-            static uint8_t F, B;
-            for (int x = 0; x < win_width; x++)
+            if (renderMode != RenderMode::HalfBlock) {
+                resolve_blocks(cells, row0, row1, x0, x1);
+                return;
+            }
+            const Kernels& kernels = Kernels::Best();
+            int top = row0 * 2 - (y_offset_odd ? 1 : 0);
+            for (int row = row0; row <= row1; row++, top += 2)
             {
-                for (int y = (y_offset_odd) ? 2 : 1; y < win_height; y += 2)
+                const Fragment* t = inRange(0, win_height - 1, top) ? back_buffer.Span(x0, top) : NULL;
+                const Fragment* b = inRange(0, win_height - 1, top + 1) ? back_buffer.Span(x0, top + 1) : NULL;
+                Cell* out = cells.Row(row);
+                kernels.resolve(t, b, outColor, BLOCK_BOT[0], out + x0, (size_t)(x1 - x0 + 1));
+                // The kernel leaves RGB pixels to us.
+                if (top > rgbBounds.y1 || top + 1 < rgbBounds.y0)
+                    continue;
+                for (int x = std::max(x0, rgbBounds.x0); x <= std::min(x1, rgbBounds.x1); x++)
                 {
-                    F = back_buffer[x][y].GetColor();
-                    B = back_buffer[x][y - 1].GetColor();
-                    wattr_set(win, WA_NORMAL, get_pair(F, B), NULL);
-                    mvwaddwstr(win, y / 2, x, BLOCK_BOT);
+                    if (t && t[x - x0].rgb)
+                        out[x].b = back_rgb(x, top);
+                    if (b && b[x - x0].rgb)
+                        out[x].f = back_rgb(x, top + 1);
                 }
             }
-            if (y_offset_odd)
+        }
+        // resolve_cells() for the modes with more than two pixels per character.
+        void resolve_blocks(CellBuffer& cells, int row0, int row1, int x0, int x1)
+        {
+            const std::array<wchar_t, 256>& glyphs = GlyphTable(renderMode);
+            uint32_t block[8];
+            for (int row = row0; row <= row1; row++)
             {
-                for (int x = 0; x < win_width; x++)
+                Cell* out = cells.Row(row);
+                for (int column = x0; column <= x1; column++)
                 {
-                    F = back_buffer[x][0].GetColor();
-                    B = outColor;
-                    wattr_set(win, WA_NORMAL, get_pair(F, B), NULL);
-                    mvwaddwstr(win, 0, x, BLOCK_BOT);
+                    int n = 0;
+                    for (int y = row * cellH; y < (row + 1) * cellH; y++)
+                        for (int x = column * cellW; x < (column + 1) * cellW; x++)
+                            block[n++] = x < win_width && y < win_height ? pixel_color(x, y) : outColor;
+                    out[column] = ResolveBlock(block, n, glyphs);
                 }
             }
-            if (y_last_odd)
+        }
+        /*
+            Resolves the back buffer into cells. With damage tracking only the cells
+            that changed since this cell buffer was last resolved are, which covers
+            this frame's damage and every frame in between for the pipelined buffers.
+        */
+        void draw_back_buffer()
+        {
+            CellBuffer& cells = frames.Back();
+            const unsigned long frame = frameCount + 1;
+            const int buffer = frames.BackIndex();
+            const unsigned long last = bufferFrame[buffer];
+            bufferFrame[buffer] = frame;
+
+            frameCells.Clear();
+            if (!damageTracking || last == 0 || frame - last > DAMAGE_HISTORY || damage.Full())
+                frameCells.AddAll();
+            else
             {
-                for (int x = 0; x < win_width; x++)
+                const int odd = y_offset_odd ? 1 : 0;
+                for (const DamageRect& r : damage.Rects())
+                    frameCells.Add(r.x0 / cellW, (r.y0 + odd) / cellH, r.x1 / cellW, (r.y1 + odd) / cellH);
+                // The buffer still holds its own text, and misses what changed while it was away.
+                frameCells.Add(textHistory[last % DAMAGE_HISTORY]);
+                for (unsigned long f = last + 1; f < frame; f++)
+                    frameCells.Add(cellHistory[f % DAMAGE_HISTORY]);
+            }
+            for (const DamageRect& r : frameCells.Rects())
+                resolve_cells(cells, r.y0, r.y1, r.x0, r.x1);
+        }
+        // Forgets this frame's damage, the parts later frames may need go into the history.
+        void finish_damage()
+        {
+            const unsigned long frame = frameCount + 1;
+            cellHistory[frame % DAMAGE_HISTORY].Clear();
+            cellHistory[frame % DAMAGE_HISTORY].Add(frameCells);
+            textHistory[frame % DAMAGE_HISTORY].Clear();
+            textHistory[frame % DAMAGE_HISTORY].Add(textCells);
+            // Clear() empties prevDrawn, without one the drawing piles up.
+            prevDrawn.Add(drawn);
+            drawn.Clear();
+            damage.Clear();
+            cleared.Clear();
+            textCells.Clear();
+            clearedThisFrame = false;
+            frameLists.clear();
+        }
+        // Sends the cells that changed since last frame to the terminal, region limits where to look.
+        void present_cells(const CellBuffer& cells, const DamageRegion* region = nullptr)
+        {
+            auto emit = [this](int row, int x, const Cell* run, int n) {
+                output->PutCells(row, x, run, n);
+            };
+            const auto start = Time::now();
+            pairs.BeginFrame();
+            output->BeginFrame();
+            if (region)
+                presenter.Present(cells, *region, emit);
+            else
+                presenter.Present(cells, emit);
+            // Cells that did not make it count as shown, unless everything is sent again.
+            if (!output->EndFrame())
+                presenter.Invalidate();
+            if (backpressure && !headless) {
+                float ms = std::chrono::duration<float, std::milli>(Time::now() - start).count();
+                // Cells sent with reduced colors stay as they are, they only show the palette color differently.
+                if (outputMonitor.Presented(output->PendingBytes(), ms)) {
+                    output->SetReducedColor(outputMonitor.Level() >= OutputLevel::ReducedColor);
+                    outputLevel = outputMonitor.Level();
+                }
+            }
+            if (pairs.AnyEvicted()) {
+                if (!pairs.OverBudget())
+                    invalidate_evicted_pairs();
+                pairs.ClearEvicted();
+            }
+        }
+        // A redefined pair recolors the cells on screen that still use it, they are painted again next frame.
+        void invalidate_evicted_pairs()
+        {
+            const CellBuffer& shown = presenter.Front();
+            const QuantizeLUT& lut = QuantizeLUT::For(paletteColors);
+            for (int y = 0; y < shown.Height(); y++)
+            {
+                const Cell* row = shown.Row(y);
+                // The pair the backend used, RGB cells got it for their nearest colors.
+                auto evicted = [&](int x) {
+                    return pairs.Evicted(CellPaletteColor(row[x].f, lut, x, 2 * y + 1), CellPaletteColor(row[x].b, lut, x, 2 * y));
+                };
+                for (int x = 0; x < shown.Width(); )
                 {
-                    F = outColor;
-                    B = back_buffer[x][win_height - 1].GetColor();
-                    wattr_set(win, WA_NORMAL, get_pair(F, B), NULL);
-                    mvwaddwstr(win, (win_height) / 2, x, BLOCK_BOT);
+                    if (!evicted(x)) {
+                        x++;
+                        continue;
+                    }
+                    int start = x;
+                    while (x < shown.Width() && evicted(x))
+                        x++;
+                    presenter.Invalidate(start, y, x - start);
                 }
             }
         }
-        void drawCircle_8p(const int& center_x, const int& center_y, const int& x, const int& y, const uint8_t& color)
-        {
-            Draw(center_x + x, center_y + y, color);
-            Draw(center_x - x, center_y + y, color);
-            Draw(center_x + x, center_y - y, color);
-            Draw(center_x - x, center_y - y, color);
-            Draw(center_x + y, center_y + x, color);
-            Draw(center_x - y, center_y + x, color);
-            Draw(center_x + y, center_y - x, color);
-            Draw(center_x - y, center_y - x, color);
-        }      
-        void drawSVLine(const int& x, int y0, const int& y1, const uint8_t& color)
-        {
-            for (; y0 >= y1; y0--)
-                Draw(x, y0, color);
-        }          
-        void fillCircle_8p(const int& center_x, const int& center_y, const int& x, const int& y, const uint8_t& color)
-        {
-            drawCircle_8p(center_x, center_y, x, y, color);
-            drawSVLine(center_x + x, center_y + y, center_y - y, color);
-            drawSVLine(center_x - x, center_y + y, center_y - y, color);
-            drawSVLine(center_x + y, center_y + x, center_y - x, color);
-            drawSVLine(center_x - y, center_y + x, center_y - x, color);
-        }  
+        void publish_frame()
+        {
+            if (frames.Publish())
+                droppedPresents++;
+            // Notifying without the mutex never blocks, a missed wakeup is covered by the wait timeout.
+            frameReady.notify_one();
+        }
+        // Body of the presenting thread in pipelined mode.
+        void present_loop()
+        {
+            while (presenting)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(frameMutex);
+                    frameReady.wait_for(lock, std::chrono::milliseconds(5), [this] { return frames.HasNew() || !presenting; });
+                }
+                if (!frames.Acquire())
+                    continue;
+                std::lock_guard<std::mutex> lock(cursesMutex);
+                present_cells(frames.Front());
+            }
+        }
+        // Whether the frame thread presents this frame, the pipelined present only ever shows the latest one anyway.
+        bool should_present()
+        {
+            if (!backpressure || headless)
+                return true;
+            return outputMonitor.ShouldPresent(frameCount + 1, output->PendingBytes());
+        }
+        // present_cells() for the frame thread, counting what the profiler wants to know.
+        void profiled_present()
+        {
+            // Cells that changed in skipped frames are not in this frame's damage.
+            const DamageRegion* region = damageTracking && !presentAll ? &frameCells : nullptr;
+            presentAll = false;
+            if (!profiler.Enabled()) {
+                present_cells(frames.Back(), region);
+                return;
+            }
+            ColorPairStats before = pairs.Stats();
+            present_cells(frames.Back(), region);
+            const ColorPairStats& after = pairs.Stats();
+            profiler.Count(ProfileCounter::PairLookups, (after.hits + after.misses) - (before.hits + before.misses));
+            profiler.Count(ProfileCounter::PairMisses, after.misses - before.misses);
+            profiler.Count(ProfileCounter::BytesOut, output->BytesLastFrame());
+        }
+        static uint64_t cell_count(const DamageRegion& region)
+        {
+            uint64_t n = 0;
+            for (const DamageRect& r : region.Rects())
+                n += (uint64_t)(r.x1 - r.x0 + 1) * (r.y1 - r.y0 + 1);
+            return n;
+        }
+        // Averages of the last second or so of frames, drawn as text in the bottom left corner.
+        void draw_profile_overlay()
+        {
+            const FrameProfile avg = profiler.Average(60);
+            auto ms = [&](ProfilePhase p) { return avg.phaseTime[(int)p] / 1e6; };
+            char line[4][96];
+            snprintf(line[0], sizeof(line[0]), "frame %6.2f ms  input %5.2f  update %5.2f",
+                avg.duration / 1e6, ms(ProfilePhase::Input), ms(ProfilePhase::Update));
+            snprintf(line[1], sizeof(line[1]), "raster %5.2f  resolve %5.2f  text %5.2f",
+                ms(ProfilePhase::Rasterize), ms(ProfilePhase::Resolve), ms(ProfilePhase::Text));
+            snprintf(line[2], sizeof(line[2]), "present %5.2f  wait %5.2f", ms(ProfilePhase::Present), ms(ProfilePhase::Wait));
+            snprintf(line[3], sizeof(line[3]), "pairs %llu (%llu new)  bytes %llu  cells %llu",
+                (unsigned long long)avg.counters[(int)ProfileCounter::PairLookups],
+                (unsigned long long)avg.counters[(int)ProfileCounter::PairMisses],
+                (unsigned long long)avg.counters[(int)ProfileCounter::BytesOut],
+                (unsigned long long)avg.counters[(int)ProfileCounter::CellsResolved]);
+            for (int i = 0; i < 4; i++)
+                DrawString(0, win_height - (4 - i) * cellH, line[i], COLOR_YELLOW);
+        }
+        // Nearest pixel, far away coordinates (and NaN) are clamped so lines to them stay finite.
+        static int to_pixel(float v)
+        {
+            return (int)std::floor(std::fmax(-65536.0f, std::fmin(v, 65536.0f)) + 0.5f);
+        }
+        // Line of a polyline, damage is already recorded. Lines wholly outside of the window are skipped.
+        void polyline_segment(int x0, int y0, int x1, int y1, uint8_t color)
+        {
+            if (std::max(x0, x1) < 0 || std::min(x0, x1) >= win_width || std::max(y0, y1) < 0 || std::min(y0, y1) >= win_height)
+                return;
+            if (deferred) {
+                tiles.Add(DrawCommand::Line(x0, y0, x1, y1, color));
+                return;
+            }
+            LinePixels(x0, y0, x1, y1, [&](int x, int y) {
+                if (inRange(0, win_width - 1, x) && inRange(0, win_height - 1, y)) {
+                    Fragment& frag = (*target)(x, y);
+                    frag.state = true;
+                    frag.rgb = false;
+                    frag.f = color;
+                }
+            });
+        }
+        // Fills pixels x0..x1 of row y, clipped to the back buffer.
+        void fill_span(int x0, int x1, int y, uint8_t color)
+        {
+            if (!inRange(0, win_height - 1, y))
+                return;
+            x0 = std::max(x0, 0);
+            x1 = std::min(x1, win_width - 1);
+            if (x0 <= x1)
+                FillSpan(*target, x0, x1 + 1, y, Fragment{ color, color, true });
+        }
         bool inRange(const int& low, const int& high, const int& x)
         {            
             return (low <= x && x <= high);
         }
+        // Aligns a string already copied into the arena and queues it for draw_strings().
+        void submit_text(TextRun& run, size_t length, int x, int y, uint8_t fColor, bool alpha, Align alignment)
+        {
+            switch(alignment) {
+                case Align::Left: break;
+                case Align::Center: x -= (int)length * cellW / 2; break;
+                case Align::Right:  x -= (int)length * cellW; break;
+            }            
+            run.length = (uint32_t)length;
+            run.x = std::clamp(x / cellW, 0, cell_columns());
+            run.y = y / cellH;
+            run.alpha = alpha;
+            run.f = fColor;
+            // A full queue means thousands of strings this frame, the rest is dropped.
+            text.Submit(run);
+        }
+        // Writes the strings drawn this frame over the resolved cells.
         void draw_strings()
         {
-            auto i = strQueue.pop();
-            cge_string str;
-            uint8_t b;
-            wchar_t ch[2];            
-            while (i)
+            CellBuffer& cells = frames.Back();
+            size_t n;
+            while ((n = text.Drain(textBatch, 64)) > 0)
             {
-                str = *i;
-
-                for (int j = 0; j < str.str.length(); j++)
+                for (size_t k = 0; k < n; k++)
                 {
-                    if (str.x + j >= win_width)
-                        break;
-                    if (str.alpha && str.str[j] == L' ')
+                    const TextRun& run = textBatch[k];
+                    if (run.y < 0 || run.y >= cells.Height())
                         continue;
-                    
-                    b = back_buffer[str.x + j][str.y * 2].GetColor();
 
-                    wattr_set(win, WA_NORMAL, get_pair(str.f, b), NULL);
-                    ch[0] = str.str[j]; ch[1] = L'\0';
-                    mvwaddwstr(win, str.y, str.x + j, ch);
+                    const wchar_t* str = text.Chars(run);
+                    int end = std::min<int>(run.x + run.length, cells.Width());
+                    Cell* row = cells.Row(run.y);
+                    if (damageTracking && run.x < end) {
+                        textCells.Add(run.x, run.y, end - 1, run.y);
+                        frameCells.Add(run.x, run.y, end - 1, run.y);
+                    }
+                    for (int x = run.x; x < end; x++)
+                    {
+                        wchar_t ch = str[x - run.x];
+                        if (run.alpha && ch == L' ')
+                            continue;
+
+                        row[x].f = run.f;
+                        // Other modes keep the main color of the cell behind the text.
+                        if (renderMode == RenderMode::HalfBlock)
+                            row[x].b = pixel_color(x, run.y * 2);
+                        row[x].ch = ch;
+                    }
                 }
-                i = strQueue.pop();
             }
+            text.Reset();
         }
-        void handle_input()
+        // Reads everything waiting from ncurses, the caller holds cursesMutex.
+        void read_input(std::vector<InputEvent>& out)
         {
             int input;
             while ((input = wgetch(win)) != ERR)
             {
-                if (input == KEY_MOUSE)
+                if (input != KEY_MOUSE)
+                    out.push_back(inputReader.Key(input));
+                else if (getmouse(&mouseEvent) == OK)
                 {
-                    if (getmouse(&mouseEvent) == OK) {
-                        int x = std::clamp(mouseEvent.x - x_offset, 0, win_width - 1);
-                        int y = std::clamp(mouseEvent.y * 2 - y_offset, 0, win_height - 1);
-                        OnMouseEvent(x, y, mouseEvent.bstate);
-                    }
+                    int x = std::clamp(mouseEvent.x * cellW - x_offset, 0, win_width - 1);
+                    int y = std::clamp(mouseEvent.y * cellH - y_offset, 0, win_height - 1);
+                    out.push_back(inputReader.Mouse(x, y, mouseEvent.bstate));
                 }
-                else {
-                    OnKeyPressed(input);
+            }
+        }
+        // Body of the input thread, see SetInputThread().
+        void input_loop()
+        {
+            std::vector<InputEvent> pending;
+            pollfd stdinPoll{ STDIN_FILENO, POLLIN, 0 };
+            while (reading)
+            {
+                // Waking up now and then also reads what ncurses has buffered already.
+                if (pending.empty())
+                    poll(&stdinPoll, 1, 5);
+                {
+                    std::lock_guard<std::mutex> lock(cursesMutex);
+                    read_input(pending);
                 }
+                CoalesceMoves(pending);
+                size_t sent = 0;
+                while (sent < pending.size() && inputQueue.push(InputEvent(pending[sent])))
+                    sent++;
+                pending.erase(pending.begin(), pending.begin() + sent);
+                // The frame loop is behind, what did not fit is coalesced further next time.
+                if (!pending.empty())
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        void handle_input()
+        {
+            frameInput.clear();
+            if (replaying)
+                replay.Take(frameCount + 1, frameInput);
+            else if (!win)
+                return;
+            else if (inputThread.joinable())
+            {
+                while (std::optional<InputEvent> ev = inputQueue.try_pop())
+                    frameInput.push_back(*ev);
+            }
+            else
+            {
+                // While a frame is being presented input waits for the next frame, it stays buffered until then.
+                std::unique_lock<std::mutex> lock(cursesMutex, std::try_to_lock);
+                if (!lock)
+                    return;
+                read_input(frameInput);
+            }
+            CoalesceMoves(frameInput);
+            for (const InputEvent& ev : frameInput)
+                recorder.Record(frameCount + 1, ev);
+            // Callbacks run without the lock, they may draw or call ClearStd().
+            for (const InputEvent& ev : frameInput)
+            {
+                if (ev.type == InputType::Key)
+                    OnKeyPressed(ev.key);
+                else
+                    OnMouseEvent(ev.x, ev.y, ev.bstate);
             }
         }
     };
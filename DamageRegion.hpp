@@ -0,0 +1,131 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+namespace cge
+{
+    // Both corners inclusive.
+    struct DamageRect
+    {
+        int x0, y0, x1, y1;
+
+        int64_t Area() const { return (int64_t)(x1 - x0 + 1) * (y1 - y0 + 1); }
+        bool Contains(const DamageRect& r) const { return x0 <= r.x0 && y0 <= r.y0 && r.x1 <= x1 && r.y1 <= y1; }
+        // True for rectangles that overlap or share an edge.
+        bool Touches(const DamageRect& r) const { return r.x0 <= x1 + 1 && x0 <= r.x1 + 1 && r.y0 <= y1 + 1 && y0 <= r.y1 + 1; }
+        DamageRect Union(const DamageRect& r) const
+        {
+            return DamageRect{ std::min(x0, r.x0), std::min(y0, r.y0), std::max(x1, r.x1), std::max(y1, r.y1) };
+        }
+    };
+
+    /*
+        Area that changed, kept as a few rectangles clipped to a w x h surface.
+        Rectangles that touch are merged when their union does not cover much
+        more than they do, and past MAX_RECTS the pair wasting the least is
+        merged, so the region only ever grows to cover more than asked for.
+    */
+    class DamageRegion
+    {
+    public:
+        static constexpr size_t MAX_RECTS = 16;
+
+    private:
+        std::vector<DamageRect> rects;
+        int width = 0, height = 0;
+        bool full = false;
+
+        static bool worth_merging(const DamageRect& a, const DamageRect& b)
+        {
+            return a.Union(b).Area() <= (a.Area() + b.Area()) * 2 + 64;
+        }
+        void merge_cheapest()
+        {
+            size_t bi = 0, bj = 1;
+            int64_t best = INT64_MAX;
+            for (size_t i = 0; i < rects.size(); i++)
+                for (size_t j = i + 1; j < rects.size(); j++)
+                {
+                    int64_t waste = rects[i].Union(rects[j]).Area() - rects[i].Area() - rects[j].Area();
+                    if (waste < best) {
+                        best = waste;
+                        bi = i;
+                        bj = j;
+                    }
+                }
+            rects[bi] = rects[bi].Union(rects[bj]);
+            rects.erase(rects.begin() + bj);
+        }
+
+    public:
+        DamageRegion() { rects.reserve(MAX_RECTS + 1); }
+
+        // Size of the surface, drops the current region.
+        void Resize(int w, int h)
+        {
+            width = w;
+            height = h;
+            Clear();
+        }
+        int Width() const { return width; }
+        int Height() const { return height; }
+
+        void Add(int x0, int y0, int x1, int y1)
+        {
+            if (full)
+                return;
+            DamageRect r{ std::max(x0, 0), std::max(y0, 0), std::min(x1, width - 1), std::min(y1, height - 1) };
+            if (r.x0 > r.x1 || r.y0 > r.y1)
+                return;
+            // Pixel by pixel drawing mostly lands in the rectangle added last.
+            if (!rects.empty() && rects.back().Contains(r))
+                return;
+            for (size_t i = 0; i < rects.size(); )
+            {
+                if (rects[i].Contains(r))
+                    return;
+                if (rects[i].Touches(r) && worth_merging(rects[i], r)) {
+                    r = r.Union(rects[i]);
+                    rects.erase(rects.begin() + i);
+                    i = 0;
+                }
+                else
+                    i++;
+            }
+            if (r.x0 == 0 && r.y0 == 0 && r.x1 == width - 1 && r.y1 == height - 1) {
+                AddAll();
+                return;
+            }
+            rects.push_back(r);
+            if (rects.size() > MAX_RECTS)
+                merge_cheapest();
+        }
+        void Add(const DamageRect& r) { Add(r.x0, r.y0, r.x1, r.y1); }
+        void Add(const DamageRegion& other)
+        {
+            if (other.full)
+                AddAll();
+            else
+                for (const DamageRect& r : other.rects)
+                    Add(r);
+        }
+        // Marks the whole surface.
+        void AddAll()
+        {
+            rects.clear();
+            full = true;
+            if (width > 0 && height > 0)
+                rects.push_back(DamageRect{ 0, 0, width - 1, height - 1 });
+        }
+        void Clear()
+        {
+            rects.clear();
+            full = false;
+        }
+        bool Full() const { return full; }
+        bool Empty() const { return rects.empty(); }
+        // Rectangles may overlap each other.
+        const std::vector<DamageRect>& Rects() const { return rects; }
+    };
+}
@@ -0,0 +1,263 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "DrawCommand.hpp"
+#include "DamageRegion.hpp"
+
+namespace cge
+{
+    class CursesGameEngine;
+
+    // Stays valid until its primitive is removed, a stale handle is ignored.
+    struct DisplayHandle
+    {
+        uint32_t index = UINT32_MAX;
+        uint32_t generation = 0;
+    };
+
+    /*
+        Primitives that stay on screen from frame to frame, rasterized once into a
+        cached layer. Adding a primitive only draws that primitive on top, removing
+        or changing one redraws just the area it covered, clipped to that area.
+        Pixels no primitive touched are transparent (state == false).
+        Primitives are drawn in the order they were added, Modify() keeps the place.
+    */
+    class DisplayList
+    {
+        struct Item
+        {
+            DrawCommand cmd;
+            uint32_t slot;
+            bool alive;
+        };
+        struct Slot
+        {
+            uint32_t generation = 0;
+            uint32_t item = UINT32_MAX;  // UINT32_MAX when free
+        };
+
+        std::vector<Item> items;  // in drawing order, removed ones are compacted away lazily
+        std::vector<Slot> slots;
+        std::vector<uint32_t> freeSlots;
+        size_t alive = 0;
+
+        Framebuffer layer;
+        int width = 0, height = 0;
+        size_t drawnItems = 0;  // items[0, drawnItems) are in the layer
+        bool dirty = false;     // [dirtyLeft, dirtyRight] x [dirtyTop, dirtyBottom] must be redrawn
+        int dirtyLeft = 0, dirtyTop = 0, dirtyRight = 0, dirtyBottom = 0;
+        int usedLeft = 0, usedTop = 0, usedRight = -1, usedBottom = -1;  // everything drawn lies inside
+        unsigned long version = 0;
+        bool cleared = false;  // Clear() emptied the layer since the last Update()
+        DamageRegion changes;  // parts of the layer that changed since ForgetChanges()
+        uint32_t owner = 0;    // how the engine drawing the list tells its pixels apart, 0 = not drawn yet
+
+        friend class CursesGameEngine;
+
+        Item* find(DisplayHandle h)
+        {
+            if (h.index >= slots.size() || slots[h.index].generation != h.generation || slots[h.index].item == UINT32_MAX)
+                return nullptr;
+            return &items[slots[h.index].item];
+        }
+        void mark_dirty(const DrawCommand& c)
+        {
+            if (!dirty) {
+                dirtyLeft = c.left; dirtyTop = c.top;
+                dirtyRight = c.right; dirtyBottom = c.bottom;
+                dirty = true;
+                return;
+            }
+            dirtyLeft = std::min(dirtyLeft, c.left);
+            dirtyTop = std::min(dirtyTop, c.top);
+            dirtyRight = std::max(dirtyRight, c.right);
+            dirtyBottom = std::max(dirtyBottom, c.bottom);
+        }
+        void grow_used(const DrawCommand& c)
+        {
+            if (usedRight < usedLeft) {
+                usedLeft = c.left; usedTop = c.top;
+                usedRight = c.right; usedBottom = c.bottom;
+                return;
+            }
+            usedLeft = std::min(usedLeft, c.left);
+            usedTop = std::min(usedTop, c.top);
+            usedRight = std::max(usedRight, c.right);
+            usedBottom = std::max(usedBottom, c.bottom);
+        }
+        void compact()
+        {
+            size_t n = 0;
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                if (!items[i].alive)
+                    continue;
+                items[n] = items[i];
+                slots[items[n].slot].item = (uint32_t)n;
+                n++;
+            }
+            items.resize(n);
+        }
+        // Redraws everything that overlaps the inclusive rectangle, clipped to it.
+        void redraw(int x0, int y0, int x1, int y1)
+        {
+            x0 = std::max(x0, 0); y0 = std::max(y0, 0);
+            x1 = std::min(x1, width - 1); y1 = std::min(y1, height - 1);
+            if (x0 > x1 || y0 > y1)
+                return;
+            for (int y = y0; y <= y1; y++)
+                FillSpan(layer, x0, x1 + 1, y, Fragment{ 0, 0, false });
+            for (const Item& it : items)
+            {
+                const DrawCommand& c = it.cmd;
+                if (it.alive && c.right >= x0 && c.left <= x1 && c.bottom >= y0 && c.top <= y1)
+                    RasterizeCommand(c, layer, x0, y0, x1, y1);
+            }
+        }
+
+    public:
+        DisplayHandle Add(const DrawCommand& c)
+        {
+            uint32_t s;
+            if (!freeSlots.empty()) {
+                s = freeSlots.back();
+                freeSlots.pop_back();
+            }
+            else {
+                s = (uint32_t)slots.size();
+                slots.emplace_back();
+            }
+            slots[s].item = (uint32_t)items.size();
+            items.push_back(Item{ c, s, true });
+            alive++;
+            return DisplayHandle{ s, slots[s].generation };
+        }
+        // Returns false for a stale handle.
+        bool Remove(DisplayHandle h)
+        {
+            Item* it = find(h);
+            if (!it)
+                return false;
+            if ((size_t)(it - items.data()) < drawnItems)
+                mark_dirty(it->cmd);
+            it->alive = false;
+            slots[h.index].item = UINT32_MAX;
+            slots[h.index].generation++;
+            freeSlots.push_back(h.index);
+            alive--;
+            return true;
+        }
+        // Replaces the primitive behind h, it keeps its place in the drawing order.
+        bool Modify(DisplayHandle h, const DrawCommand& c)
+        {
+            Item* it = find(h);
+            if (!it)
+                return false;
+            if ((size_t)(it - items.data()) < drawnItems) {
+                mark_dirty(it->cmd);
+                mark_dirty(c);
+                grow_used(c);
+            }
+            it->cmd = c;
+            return true;
+        }
+        const DrawCommand* Get(DisplayHandle h)
+        {
+            Item* it = find(h);
+            return it ? &it->cmd : nullptr;
+        }
+        void Clear()
+        {
+            for (const Item& it : items)
+                if (it.alive) {
+                    slots[it.slot].item = UINT32_MAX;
+                    slots[it.slot].generation++;
+                    freeSlots.push_back(it.slot);
+                }
+            items.clear();
+            alive = 0;
+            drawnItems = 0;
+            dirty = false;
+            int x0, y0, x1, y1;
+            if (UsedBounds(x0, y0, x1, y1))
+            {
+                changes.Add(x0, y0, x1, y1);
+                for (int y = y0; y <= y1; y++)
+                    FillSpan(layer, x0, x1 + 1, y, Fragment{ 0, 0, false });
+            }
+            usedRight = usedBottom = -1;
+            usedLeft = usedTop = 0;
+            cleared = true;
+        }
+        size_t Size() const { return alive; }
+
+        /*
+            Brings the cached layer up to date for a w x h target and returns true if
+            it changed since the last call. A new size redraws everything.
+        */
+        bool Update(int w, int h)
+        {
+            bool changed = cleared;
+            cleared = false;
+            if (w != width || h != height)
+            {
+                width = w;
+                height = h;
+                layer.Resize(w, h);
+                FillAll(layer, Fragment{ 0, 0, false });
+                changes.Resize(w, h);
+                changes.AddAll();
+                drawnItems = 0;
+                dirty = false;
+                usedRight = usedBottom = -1;
+                usedLeft = usedTop = 0;
+                changed = true;
+            }
+            if (items.size() - alive > std::max<size_t>(alive, 64))
+            {
+                // Compacting keeps the drawing order, so the drawn prefix stays a prefix.
+                size_t drawnAlive = 0;
+                for (size_t i = 0; i < drawnItems; i++)
+                    drawnAlive += items[i].alive;
+                compact();
+                drawnItems = drawnAlive;
+            }
+            if (dirty)
+            {
+                // Redrawing the area includes primitives added since, drawing those again
+                // below gives the same pixels as they are on top of everything else.
+                redraw(dirtyLeft, dirtyTop, dirtyRight, dirtyBottom);
+                changes.Add(dirtyLeft, dirtyTop, dirtyRight, dirtyBottom);
+                dirty = false;
+                changed = true;
+            }
+            for (; drawnItems < items.size(); drawnItems++)
+            {
+                const Item& it = items[drawnItems];
+                if (!it.alive)
+                    continue;
+                RasterizeCommand(it.cmd, layer, 0, 0, width - 1, height - 1);
+                grow_used(it.cmd);
+                changes.Add(it.cmd.left, it.cmd.top, it.cmd.right, it.cmd.bottom);
+                changed = true;
+            }
+            if (changed)
+                version++;
+            return changed;
+        }
+        // Pixels of the layer that changed in the calls to Update() since ForgetChanges().
+        const DamageRegion& Changes() const { return changes; }
+        void ForgetChanges() { changes.Clear(); }
+        // Incremented every time the layer changes.
+        unsigned long Version() const { return version; }
+        const Framebuffer& Layer() const { return layer; }
+        // Bounds of every pixel drawn so far, clipped to the layer. False when nothing was drawn.
+        bool UsedBounds(int& x0, int& y0, int& x1, int& y1) const
+        {
+            x0 = std::max(usedLeft, 0); y0 = std::max(usedTop, 0);
+            x1 = std::min(usedRight, width - 1); y1 = std::min(usedBottom, height - 1);
+            return x0 <= x1 && y0 <= y1;
+        }
+    };
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include <algorithm>
+#include "Fragment.hpp"
+#include "Raster.hpp"
+#include "Kernels.hpp"
+
+namespace cge
+{
+    enum class DrawOp : uint8_t { Clear, Pixel, Line, Circle, Rectangle, FillRectangle, FillCircle, FillPie };
+
+    // One recorded primitive, enough to rasterize it again later.
+    struct DrawCommand
+    {
+        DrawOp op;
+        uint8_t color;
+        int x0, y0, x1, y1;  // circles keep the radius in x1
+        float a0, a1;
+        int left, top, right, bottom;  // inclusive bounds of the touched pixels
+
+        // Resets the rectangle to color, the pixels count as untouched again.
+        static DrawCommand Clear(int x0, int y0, int x1, int y1, uint8_t color)
+        {
+            return DrawCommand{ DrawOp::Clear, color, x0, y0, x1, y1, 0, 0, x0, y0, x1, y1 };
+        }
+        static DrawCommand Pixel(int x, int y, uint8_t color)
+        {
+            return DrawCommand{ DrawOp::Pixel, color, x, y, x, y, 0, 0, x, y, x, y };
+        }
+        static DrawCommand Line(int x0, int y0, int x1, int y1, uint8_t color)
+        {
+            return DrawCommand{ DrawOp::Line, color, x0, y0, x1, y1, 0, 0,
+                std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1) };
+        }
+        static DrawCommand Rectangle(int x0, int y0, int x1, int y1, uint8_t color, bool fill = false)
+        {
+            return DrawCommand{ fill ? DrawOp::FillRectangle : DrawOp::Rectangle, color, x0, y0, x1, y1, 0, 0,
+                std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1) };
+        }
+        static DrawCommand Circle(int center_x, int center_y, int r, uint8_t color, bool fill = false)
+        {
+            // The outline of a zero radius circle reaches one pixel out.
+            int e = fill ? r : std::max(r, 1);
+            return DrawCommand{ fill ? DrawOp::FillCircle : DrawOp::Circle, color, center_x, center_y, r, 0, 0, 0,
+                detail::clamp_int((long long)center_x - e), detail::clamp_int((long long)center_y - e),
+                detail::clamp_int((long long)center_x + e), detail::clamp_int((long long)center_y + e) };
+        }
+        static DrawCommand Pie(int center_x, int center_y, int r, float startAngle, float endAngle, uint8_t color)
+        {
+            return DrawCommand{ DrawOp::FillPie, color, center_x, center_y, r, 0, startAngle, endAngle,
+                detail::clamp_int((long long)center_x - r), detail::clamp_int((long long)center_y - r),
+                detail::clamp_int((long long)center_x + r), detail::clamp_int((long long)center_y + r) };
+        }
+    };
+
+    /*
+        Rasterizes c into fb, touching only pixels inside the inclusive clip
+        rectangle, which has to lie within fb. Outlines only set the foreground
+        like CursesGameEngine::Draw() does, fills overwrite whole fragments.
+    */
+    inline void RasterizeCommand(const DrawCommand& c, Framebuffer& fb, int cx0, int cy0, int cx1, int cy1)
+    {
+        auto plot = [&](int x, int y) {
+            if (cx0 <= x && x <= cx1 && cy0 <= y && y <= cy1) {
+                Fragment& frag = fb(x, y);
+                frag.state = true;
+                frag.rgb = false;
+                frag.f = c.color;
+            }
+        };
+        auto span = [&](int x0, int x1, int y) {
+            if (y < cy0 || y > cy1)
+                return;
+            x0 = std::max(x0, cx0);
+            x1 = std::min(x1, cx1);
+            if (x0 <= x1)
+                FillSpan(fb, x0, x1 + 1, y, Fragment{ c.color, c.color, true });
+        };
+        switch (c.op)
+        {
+            case DrawOp::Clear:
+                for (int y = std::max(cy0, c.top); y <= std::min(cy1, c.bottom); y++)
+                    if (std::max(cx0, c.left) <= std::min(cx1, c.right))
+                        FillSpan(fb, std::max(cx0, c.left), std::min(cx1, c.right) + 1, y, Fragment{ c.color, c.color, false });
+                break;
+            case DrawOp::Pixel: plot(c.x0, c.y0); break;
+            case DrawOp::Line: LinePixels(c.x0, c.y0, c.x1, c.y1, plot); break;
+            case DrawOp::Circle: CirclePixels(c.x0, c.y0, c.x1, plot); break;
+            case DrawOp::Rectangle: RectanglePixels(c.x0, c.y0, c.x1, c.y1, plot); break;
+            case DrawOp::FillRectangle: FillRectangleSpans(c.x0, c.y0, c.x1, c.y1, span, cy0, cy1); break;
+            case DrawOp::FillCircle: FillCircleSpans(c.x0, c.y0, c.x1, span, cy0, cy1); break;
+            case DrawOp::FillPie: FillPieSpans(c.x0, c.y0, c.x1, c.a0, c.a1, span, cy0, cy1); break;
+        }
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include "Framebuffer_generic.hpp"
+
+namespace cge
+{
+    /*
+        One pixel, packed into a 32-bit word. With rgb set the color is not a
+        palette color but in the RGB plane next to the framebuffer, see
+        CursesGameEngine::DrawRGB(), and GetColor() means nothing.
+    */
+    struct alignas(4) Fragment
+    {
+        uint8_t f;
+        uint8_t b;
+        bool state;
+        bool rgb = false;
+
+        uint8_t GetColor() const { return state ? f : b; }
+    };
+    static_assert(sizeof(Fragment) == 4, "Fragment is expected to pack into 4 bytes");
+    typedef Framebuffer_generic<Fragment> Framebuffer;
+}
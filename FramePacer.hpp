@@ -0,0 +1,137 @@
+#pragma once
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace cge
+{
+    enum class PacingMode : uint8_t
+    {
+        Capped,     // Waits until a full frame period has passed since the previous frame.
+        Uncapped,   // Never waits.
+        VSync       // Frames start on a fixed grid of periods, missed slots are skipped.
+    };
+
+    // Frame times in milliseconds over the last FramePacer::HISTORY frames.
+    struct FrameStats
+    {
+        float min = 0.0f;
+        float avg = 0.0f;
+        float max = 0.0f;
+        float p95 = 0.0f;
+        float p99 = 0.0f;
+        unsigned long frames = 0;   // since Start()
+        unsigned long dropped = 0;  // deadlines missed since Start()
+    };
+
+    /*
+        Ends every frame at an absolute deadline. Most of the wait is a sleep,
+        the last SPIN of it is spent yielding so the deadline is not overslept.
+    */
+    class FramePacer
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+        static constexpr size_t HISTORY = 512;
+
+    private:
+        static constexpr Clock::duration SPIN = std::chrono::microseconds(1500);
+
+        PacingMode mode = PacingMode::Capped;
+        bool noTarget = false;  // no target FPS, the frames run as with PacingMode::Uncapped
+        Clock::duration period = std::chrono::microseconds(16667);
+        Clock::time_point deadline, last;
+        std::vector<float> times = std::vector<float>(HISTORY);
+        size_t next = 0, count = 0;
+        unsigned long frames = 0, dropped = 0;
+
+        void wait_until(Clock::time_point t)
+        {
+            if (t - Clock::now() > SPIN)
+                std::this_thread::sleep_until(t - SPIN);
+            while (Clock::now() < t)
+                std::this_thread::yield();
+        }
+
+    public:
+        // Frames per second to aim for, 0 or less runs uncapped until a target is set again.
+        void SetTargetFPS(float fps)
+        {
+            noTarget = fps <= 0.0f;
+            if (noTarget)
+                return;
+            period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps));
+        }
+        void SetMode(PacingMode m) { mode = m; }
+        PacingMode Mode() const { return mode; }
+
+        void Start()
+        {
+            last = Clock::now();
+            deadline = last + period;
+            next = count = 0;
+            frames = dropped = 0;
+        }
+        /*
+            Called once the frame is done. Waits as the mode requires and returns
+            the time since the previous call, in seconds.
+        */
+        float EndFrame()
+        {
+            Clock::time_point now = Clock::now();
+            switch (noTarget ? PacingMode::Uncapped : mode)
+            {
+                case PacingMode::Uncapped:
+                    break;
+                case PacingMode::Capped:
+                    if (now < deadline)
+                        wait_until(deadline);
+                    else
+                        dropped++;
+                    // After a late frame start counting again from now instead of rushing to catch up.
+                    deadline = std::max(deadline, now) + period;
+                    break;
+                case PacingMode::VSync:
+                    if (now >= deadline) {
+                        auto missed = (now - deadline) / period + 1;
+                        dropped += missed;
+                        deadline += missed * period;
+                    }
+                    wait_until(deadline);
+                    deadline += period;
+                    break;
+            }
+
+            now = Clock::now();
+            float ms = std::chrono::duration<float, std::milli>(now - last).count();
+            last = now;
+            times[next] = ms;
+            next = (next + 1) % HISTORY;
+            count = std::min(count + 1, HISTORY);
+            frames++;
+            return ms / 1000.0f;
+        }
+
+        FrameStats Stats() const
+        {
+            FrameStats s;
+            s.frames = frames;
+            s.dropped = dropped;
+            if (count == 0)
+                return s;
+
+            std::vector<float> sorted(times.begin(), times.begin() + count);
+            std::sort(sorted.begin(), sorted.end());
+            float sum = 0.0f;
+            for (float t : sorted)
+                sum += t;
+            s.min = sorted.front();
+            s.max = sorted.back();
+            s.avg = sum / count;
+            s.p95 = sorted[(count - 1) * 95 / 100];
+            s.p99 = sorted[(count - 1) * 99 / 100];
+            return s;
+        }
+    };
+}
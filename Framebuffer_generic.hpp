@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+
+namespace cge
+{
+    /*
+        Two dimensional pixel buffer in one aligned allocation, row-major.
+        Every row starts on an ALIGNMENT boundary, so rows are Pitch() elements
+        apart, which can be more than Width().
+    */
+    template<typename T>
+    class Framebuffer_generic
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Framebuffer pixels must be trivially copyable");
+
+        T* data = nullptr;
+        size_t capacity = 0;  // in bytes
+        int width = 0;
+        int height = 0;
+        int pitch = 0;
+
+    public:
+        static constexpr size_t ALIGNMENT = 64;
+
+        Framebuffer_generic() {}
+        Framebuffer_generic(int w, int h) { Resize(w, h); }
+        Framebuffer_generic(const Framebuffer_generic& other)
+        {
+            Resize(other.width, other.height);
+            if (data)
+                std::memcpy(data, other.data, SizeBytes());
+        }
+        Framebuffer_generic(Framebuffer_generic&& other) noexcept
+        {
+            swap(other);
+        }
+        Framebuffer_generic& operator=(Framebuffer_generic other) noexcept
+        {
+            swap(other);
+            return *this;
+        }
+        ~Framebuffer_generic()
+        {
+            std::free(data);
+        }
+        void swap(Framebuffer_generic& other) noexcept
+        {
+            std::swap(data, other.data);
+            std::swap(capacity, other.capacity);
+            std::swap(width, other.width);
+            std::swap(height, other.height);
+            std::swap(pitch, other.pitch);
+        }
+
+        /*
+            Changes the dimensions. The allocation is only replaced when it is
+            too small, pixel contents are unspecified afterwards.
+        */
+        void Resize(int w, int h)
+        {
+            const size_t perLine = ALIGNMENT / std::min(ALIGNMENT, sizeof(T));
+            pitch = (int)((std::max(w, 0) + perLine - 1) / perLine * perLine);
+            width = std::max(w, 0);
+            height = std::max(h, 0);
+
+            size_t bytes = (SizeBytes() + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+            if (bytes > capacity)
+            {
+                std::free(data);
+                data = static_cast<T*>(std::aligned_alloc(ALIGNMENT, bytes));
+                if (!data)
+                    throw std::bad_alloc();
+                capacity = bytes;
+            }
+        }
+
+        int Width() const { return width; }
+        int Height() const { return height; }
+        // Distance between two rows, in elements.
+        int Pitch() const { return pitch; }
+        size_t SizeBytes() const { return (size_t)pitch * height * sizeof(T); }
+        T* Data() { return data; }
+        const T* Data() const { return data; }
+
+        T* Row(int y) { return data + (size_t)y * pitch; }
+        const T* Row(int y) const { return data + (size_t)y * pitch; }
+        // Pointer to pixel (x, y), the span continues to the end of the row.
+        T* Span(int x, int y) { return Row(y) + x; }
+        const T* Span(int x, int y) const { return Row(y) + x; }
+        T& operator()(int x, int y) { return data[(size_t)y * pitch + x]; }
+        const T& operator()(int x, int y) const { return data[(size_t)y * pitch + x]; }
+
+        bool InBounds(int x, int y) const
+        {
+            return 0 <= x && x < width && 0 <= y && y < height;
+        }
+
+        void Fill(const T& value)
+        {
+            for (int y = 0; y < height; y++)
+                std::fill_n(Row(y), width, value);
+        }
+        // Fills [x0, x1) on row y. Nothing is clipped.
+        void FillSpan(int x0, int x1, int y, const T& value)
+        {
+            std::fill(Row(y) + x0, Row(y) + x1, value);
+        }
+    };
+}
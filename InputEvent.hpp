@@ -0,0 +1,71 @@
+#pragma once
+#include <ncurses.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+namespace cge
+{
+    enum class InputType : uint8_t
+    {
+        Key,          // key holds the key code
+        MouseButton,  // a button went down or up, or the wheel turned
+        MouseMove     // the pointer moved, buttons held are unchanged
+    };
+
+    struct InputEvent
+    {
+        InputType type;
+        int key;         // KEY_MOUSE for mouse events
+        int x, y;        // pixel in the window, mouse events only
+        mmask_t bstate;  // as reported by ncurses, mouse events only
+        std::chrono::steady_clock::time_point time;  // when it was read
+    };
+
+    /*
+        Turns what wgetch() and getmouse() report into InputEvents. Keeps track of
+        the buttons held, a press reported again while the button is held (which
+        is how some terminals report dragging) counts as movement.
+    */
+    class InputReader
+    {
+        static constexpr mmask_t PRESSES = BUTTON1_PRESSED | BUTTON2_PRESSED | BUTTON3_PRESSED;
+        static constexpr mmask_t RELEASES = BUTTON1_RELEASED | BUTTON2_RELEASED | BUTTON3_RELEASED;
+
+        mmask_t held = 0;  // press bits of the buttons down
+
+    public:
+        InputEvent Key(int key)
+        {
+            return InputEvent{ InputType::Key, key, 0, 0, 0, std::chrono::steady_clock::now() };
+        }
+        InputEvent Mouse(int x, int y, mmask_t bstate)
+        {
+            mmask_t press = bstate & PRESSES;
+            mmask_t release = bstate & RELEASES;
+            bool move = (bstate & REPORT_MOUSE_POSITION) && !press && !release;
+            if (press && !(press & ~held) && !release && !(bstate & ~(PRESSES | REPORT_MOUSE_POSITION)))
+                move = true;
+            held = (held | press) & ~(release << 1);  // BUTTONn_PRESSED is the bit above BUTTONn_RELEASED
+            InputType type = move || bstate == 0 ? InputType::MouseMove : InputType::MouseButton;
+            return InputEvent{ type, KEY_MOUSE, x, y, bstate, std::chrono::steady_clock::now() };
+        }
+    };
+
+    /*
+        Collapses every run of consecutive mouse moves into its last event, so a
+        fast drag costs one event per frame. Keys and button edges are kept and
+        stay in order.
+    */
+    inline void CoalesceMoves(std::vector<InputEvent>& events)
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            if (events[i].type == InputType::MouseMove && i + 1 < events.size() && events[i + 1].type == InputType::MouseMove)
+                continue;
+            events[n++] = events[i];
+        }
+        events.resize(n);
+    }
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "ByteOrder.hpp"
+#include "InputEvent.hpp"
+#include "RenderMode.hpp"
+
+namespace cge
+{
+    /*
+        Input of a run, frame by frame, so the run can be played again. Little
+        endian layout:
+
+            header   "CGEI", u32 version (1), u32 width, u32 height, u32 render mode
+            records  varint frames since the previous record, u8 kind, then
+                     for a key       varint key
+                     for the mouse   varint x, varint y, varint bstate
+            end      a record of kind END, its frame is the number of frames run
+
+        A log without its end, from a run that did not finish, plays until its
+        last record.
+    */
+    namespace input_log
+    {
+        constexpr char MAGIC[4] = { 'C', 'G', 'E', 'I' };
+        constexpr uint32_t VERSION = 1;
+        constexpr size_t HEADER_SIZE = 20;
+        // Record kinds, the first ones are InputType values.
+        constexpr uint8_t END = 0xFF;
+
+        inline void put_varint(std::vector<uint8_t>& out, uint64_t v)
+        {
+            while (v >= 0x80) {
+                out.push_back((uint8_t)(v | 0x80));
+                v >>= 7;
+            }
+            out.push_back((uint8_t)v);
+        }
+        // False if the varint runs past end or is too long.
+        inline bool get_varint(const uint8_t*& at, const uint8_t* end, uint64_t& v)
+        {
+            v = 0;
+            for (int shift = 0; at < end && shift < 64; shift += 7)
+            {
+                uint8_t b = *at++;
+                v |= (uint64_t)(b & 0x7F) << shift;
+                if (!(b & 0x80))
+                    return true;
+            }
+            return false;
+        }
+    }
+
+    struct InputLogHeader
+    {
+        int width = 0, height = 0;  // window the input was recorded in, in pixels
+        RenderMode mode = RenderMode::HalfBlock;
+    };
+
+    // Writes the input of a run as it happens.
+    class InputRecorder
+    {
+        FILE* file = NULL;
+        std::vector<uint8_t> record;
+        unsigned long lastFrame = 0;
+        bool failed = false;
+
+        void put(const void* data, size_t n)
+        {
+            if (fwrite(data, 1, n, file) != n)
+                failed = true;
+        }
+
+    public:
+        InputRecorder() {}
+        InputRecorder(const InputRecorder&) = delete;
+        InputRecorder& operator=(const InputRecorder&) = delete;
+        ~InputRecorder() { Close(lastFrame); }
+
+        bool Open(const std::string& path, const InputLogHeader& header)
+        {
+            Close(lastFrame);
+            file = fopen(path.c_str(), "wb");
+            if (!file)
+                return false;
+            failed = false;
+            lastFrame = 0;
+            const uint32_t fields[4] = { input_log::VERSION, (uint32_t)header.width, (uint32_t)header.height, (uint32_t)header.mode };
+            record.assign(input_log::MAGIC, input_log::MAGIC + 4);
+            for (uint32_t v : fields)
+                PutLE(record, v, 4);
+            put(record.data(), record.size());
+            return !failed;
+        }
+        bool IsOpen() const { return file != NULL; }
+        // Events have to come in order of their frames.
+        void Record(unsigned long frame, const InputEvent& ev)
+        {
+            if (!file)
+                return;
+            record.clear();
+            input_log::put_varint(record, frame - lastFrame);
+            record.push_back((uint8_t)ev.type);
+            if (ev.type == InputType::Key)
+                input_log::put_varint(record, (uint32_t)ev.key);
+            else {
+                input_log::put_varint(record, (uint32_t)ev.x);
+                input_log::put_varint(record, (uint32_t)ev.y);
+                input_log::put_varint(record, (uint64_t)ev.bstate);
+            }
+            put(record.data(), record.size());
+            lastFrame = frame;
+        }
+        // Ends the log of a run of frames frames, false if anything could not be written.
+        bool Close(unsigned long frames)
+        {
+            if (!file)
+                return !failed;
+            record.clear();
+            input_log::put_varint(record, frames >= lastFrame ? frames - lastFrame : 0);
+            record.push_back(input_log::END);
+            put(record.data(), record.size());
+            failed = fclose(file) != 0 || failed;
+            file = NULL;
+            return !failed;
+        }
+    };
+
+    // A recorded log read into memory and handed out frame by frame.
+    class InputReplay
+    {
+        struct Entry
+        {
+            unsigned long frame;
+            InputEvent ev;
+        };
+        InputLogHeader header;
+        std::vector<Entry> entries;
+        size_t next = 0;
+        unsigned long frames = 0;
+
+    public:
+        // False if the file cannot be read or is not an input log.
+        bool Open(const std::string& path)
+        {
+            entries.clear();
+            next = 0;
+            frames = 0;
+            FILE* f = fopen(path.c_str(), "rb");
+            if (!f)
+                return false;
+            std::vector<uint8_t> data;
+            uint8_t chunk[4096];
+            size_t n;
+            while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+                data.insert(data.end(), chunk, chunk + n);
+            fclose(f);
+
+            uint32_t fields[4];
+            if (data.size() < input_log::HEADER_SIZE || memcmp(data.data(), input_log::MAGIC, 4) != 0)
+                return false;
+            for (int f = 0; f < 4; f++)
+                fields[f] = (uint32_t)LoadLE(data.data() + 4 + f * 4, 4);
+            if (fields[0] != input_log::VERSION || fields[1] > INT32_MAX || fields[2] > INT32_MAX || fields[3] > (uint32_t)RenderMode::Braille)
+                return false;
+            header.width = (int)fields[1];
+            header.height = (int)fields[2];
+            header.mode = (RenderMode)fields[3];
+
+            // A broken record ends the log, everything before it still plays.
+            const uint8_t* at = data.data() + input_log::HEADER_SIZE;
+            const uint8_t* end = data.data() + data.size();
+            unsigned long frame = 0;
+            uint64_t delta, key, x, y, bstate;
+            while (at < end && input_log::get_varint(at, end, delta) && at < end)
+            {
+                uint8_t kind = *at++;
+                if (kind == input_log::END) {
+                    frames = frame + delta;
+                    return true;
+                }
+                if (kind == (uint8_t)InputType::Key) {
+                    if (!input_log::get_varint(at, end, key))
+                        break;
+                    frame += delta;
+                    entries.push_back(Entry{ frame, InputEvent{ InputType::Key, (int)key, 0, 0, 0, {} } });
+                }
+                else if (kind <= (uint8_t)InputType::MouseMove) {
+                    if (!input_log::get_varint(at, end, x) || !input_log::get_varint(at, end, y) || !input_log::get_varint(at, end, bstate))
+                        break;
+                    frame += delta;
+                    entries.push_back(Entry{ frame, InputEvent{ (InputType)kind, KEY_MOUSE, (int)x, (int)y, (mmask_t)bstate, {} } });
+                }
+                else
+                    break;
+            }
+            frames = frame;
+            return true;
+        }
+        const InputLogHeader& Header() const { return header; }
+        // Frames the recorded run took.
+        unsigned long Frames() const { return frames; }
+        bool Finished(unsigned long frame) const { return frame >= frames && next == entries.size(); }
+
+        // Appends the events of frame to out, frames have to be asked for in order.
+        void Take(unsigned long frame, std::vector<InputEvent>& out)
+        {
+            while (next < entries.size() && entries[next].frame <= frame)
+            {
+                out.push_back(entries[next].ev);
+                out.back().time = std::chrono::steady_clock::now();
+                next++;
+            }
+        }
+    };
+}
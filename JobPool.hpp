@@ -0,0 +1,144 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cge
+{
+    /*
+        Fixed set of threads running batches of indexed jobs. Jobs are dealt out
+        round-robin into one queue per thread, a thread that runs dry steals from
+        the back of the other queues. The calling thread works as well.
+    */
+    class JobPool
+    {
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<size_t> jobs;
+        };
+
+        std::vector<std::thread> workers;
+        std::vector<std::unique_ptr<Queue>> queues;  // queues[0] belongs to the caller of Run()
+        std::mutex mutex;
+        std::condition_variable wake, done;
+        const std::function<void(size_t)>* job = nullptr;
+        std::atomic<size_t> remaining{ 0 };
+        unsigned long generation = 0;
+        bool stop = false;
+
+        bool pop(size_t self, size_t& out)
+        {
+            {
+                Queue& q = *queues[self];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                if (!q.jobs.empty()) {
+                    out = q.jobs.front();
+                    q.jobs.pop_front();
+                    return true;
+                }
+            }
+            for (size_t i = 1; i < queues.size(); i++)
+            {
+                Queue& q = *queues[(self + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                if (!q.jobs.empty()) {
+                    out = q.jobs.back();
+                    q.jobs.pop_back();
+                    return true;
+                }
+            }
+            return false;
+        }
+        void work(size_t self)
+        {
+            size_t j;
+            while (pop(self, j))
+            {
+                (*job)(j);
+                if (remaining.fetch_sub(1) == 1) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    done.notify_all();
+                }
+            }
+        }
+        void worker_main(size_t self)
+        {
+            unsigned long seen = 0;
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [&] { return stop || generation != seen; });
+                    if (stop)
+                        return;
+                    seen = generation;
+                }
+                work(self);
+            }
+        }
+
+    public:
+        // threads counts the caller of Run() too, 0 uses every hardware thread.
+        JobPool(unsigned threads = 0)
+        {
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned i = 0; i < threads; i++)
+                queues.push_back(std::make_unique<Queue>());
+            for (unsigned i = 1; i < threads; i++)
+                workers.emplace_back(&JobPool::worker_main, this, i);
+        }
+        JobPool(const JobPool&) = delete;
+        JobPool& operator=(const JobPool&) = delete;
+        ~JobPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            wake.notify_all();
+            for (auto& t : workers)
+                t.join();
+        }
+
+        unsigned Threads() const { return (unsigned)queues.size(); }
+
+        // Runs f(0) .. f(count - 1) and returns when all of them finished.
+        void Run(size_t count, const std::function<void(size_t)>& f)
+        {
+            if (count == 0)
+                return;
+            if (workers.empty()) {
+                for (size_t i = 0; i < count; i++)
+                    f(i);
+                return;
+            }
+
+            // Set before any job is visible, a thread still looking for work may pick one up right away.
+            job = &f;
+            remaining = count;
+            for (size_t i = 0; i < count; i++)
+            {
+                Queue& q = *queues[i % queues.size()];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                q.jobs.push_back(i);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                generation++;
+            }
+            wake.notify_all();
+
+            work(0);
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [&] { return remaining == 0; });
+        }
+    };
+}
@@ -0,0 +1,369 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include "Fragment.hpp"
+#include "CellBuffer.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CGE_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace cge
+{
+    enum class SimdLevel : uint8_t { Scalar, SSE2, AVX2 };
+
+    /*
+        The per-pixel loops that run over the whole screen every frame, in a
+        scalar version and SSE2/AVX2 versions picked at runtime. All of them
+        give the same results.
+    */
+    struct Kernels
+    {
+        // Sets n fragments to value.
+        void (*fill)(Fragment* dst, size_t n, Fragment value);
+        /*
+            Resolves n cells from the pixel rows above and below them, each cell
+            gets bottom as foreground, top as background and ch. A NULL row is
+            outside the window and reads as outColor. Pixels with rgb set are
+            left to the caller.
+        */
+        void (*resolve)(const Fragment* top, const Fragment* bottom, uint8_t outColor, wchar_t ch, Cell* out, size_t n);
+        /*
+            out = layer where layer is drawn (state set) and its color is not key,
+            below elsewhere. A key outside 0..255 keys nothing. out may be below.
+        */
+        void (*merge)(const Fragment* below, const Fragment* layer, int key, Fragment* out, size_t n);
+        /*
+            Applies the affine transform m = { a, b, c, d, tx, ty } to n points kept
+            as separate x and y arrays: x' = a x + b y + tx, y' = c x + d y + ty.
+            The outputs may be the inputs.
+        */
+        void (*transform)(const float* m, const float* xs, const float* ys, float* outX, float* outY, size_t n);
+        /*
+            Quantizes n 0xAARRGGBB pixels into palette colors of dst. lut maps the
+            top 5 bits of red, green and blue (red highest) to a color and has 3
+            bytes of padding after its 32768 entries. dither[i & 7] is added to
+            all three channels of pixel i, dither has 16 entries, the last 8
+            repeating the first. Pixels with alpha 0 leave dst as it is.
+        */
+        void (*quantize)(const uint32_t* src, const uint8_t* lut, const int8_t* dither, Fragment* dst, size_t n);
+        SimdLevel level;
+
+        // Best level the CPU supports, lower if asked for more.
+        static const Kernels& Get(SimdLevel wanted);
+        static const Kernels& Best();
+    };
+
+    namespace detail
+    {
+        inline uint32_t pack_fragment(Fragment v)
+        {
+            return v.f | v.b << 8 | (uint32_t)v.state << 16 | (uint32_t)v.rgb << 24;
+        }
+
+        inline void fill_scalar(Fragment* dst, size_t n, Fragment value)
+        {
+            uint32_t v = pack_fragment(value);
+            for (size_t i = 0; i < n; i++)
+                memcpy((void*)(dst + i), &v, 4);
+        }
+        inline void resolve_scalar(const Fragment* top, const Fragment* bottom, uint8_t outColor, wchar_t ch, Cell* out, size_t n)
+        {
+            // Whole cells are stored at once, so the compiler need not reload the rows after every byte.
+            for (size_t i = 0; i < n; i++)
+                out[i] = Cell{ bottom ? bottom[i].GetColor() : outColor, top ? top[i].GetColor() : outColor, ch };
+        }
+
+        inline void merge_scalar(const Fragment* below, const Fragment* layer, int key, Fragment* out, size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+                out[i] = layer[i].state && layer[i].f != key ? layer[i] : below[i];
+        }
+
+        inline void transform_scalar(const float* m, const float* xs, const float* ys, float* outX, float* outY, size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                float x = xs[i], y = ys[i];
+                outX[i] = m[0] * x + m[1] * y + m[4];
+                outY[i] = m[2] * x + m[3] * y + m[5];
+            }
+        }
+
+        inline void quantize_scalar(const uint32_t* src, const uint8_t* lut, const int8_t* dither, Fragment* dst, size_t n)
+        {
+            auto channel = [](uint32_t p, int shift, int d) { return (uint32_t)std::clamp((int)(p >> shift & 0xFF) + d, 0, 255); };
+            for (size_t i = 0; i < n; i++)
+            {
+                const uint32_t p = src[i];
+                if (!(p >> 24))
+                    continue;
+                const int d = dither[i & 7];
+                uint8_t color = lut[(channel(p, 16, d) >> 3) << 10 | (channel(p, 8, d) >> 3) << 5 | channel(p, 0, d) >> 3];
+                dst[i] = Fragment{ color, color, true };
+            }
+        }
+#ifdef CGE_KERNELS_X86
+        __attribute__((target("sse2")))
+        inline void fill_sse2(Fragment* dst, size_t n, Fragment value)
+        {
+            if (n < 4) {
+                fill_scalar(dst, n, value);
+                return;
+            }
+            __m128i v = _mm_set1_epi32((int)pack_fragment(value));
+            for (size_t i = 0; i + 4 <= n; i += 4)
+                _mm_storeu_si128((__m128i*)(dst + i), v);
+            // The last store may overlap the previous one.
+            _mm_storeu_si128((__m128i*)(dst + n - 4), v);
+        }
+        // Colors of 4 fragments in the low byte of each lane: state ? f : b.
+        __attribute__((target("sse2")))
+        inline __m128i colors_sse2(__m128i frag)
+        {
+            const __m128i byte = _mm_set1_epi32(0xFF);
+            __m128i unset = _mm_cmpeq_epi32(_mm_and_si128(_mm_srli_epi32(frag, 16), byte), _mm_setzero_si128());
+            __m128i f = _mm_and_si128(frag, byte);
+            __m128i b = _mm_and_si128(_mm_srli_epi32(frag, 8), byte);
+            return _mm_or_si128(_mm_and_si128(unset, b), _mm_andnot_si128(unset, f));
+        }
+        __attribute__((target("sse2")))
+        inline void resolve_sse2(const Fragment* top, const Fragment* bottom, uint8_t outColor, wchar_t ch, Cell* out, size_t n)
+        {
+            const __m128i out4 = _mm_set1_epi32(outColor);
+            const __m128i ch4 = _mm_set1_epi32((int)ch);
+            size_t i = 0;
+            // Each cell is one f, b, ch, 0 vector.
+            const __m128i tail = _mm_unpacklo_epi32(ch4, _mm_setzero_si128());
+            for (; i + 4 <= n; i += 4)
+            {
+                __m128i t = top ? colors_sse2(_mm_loadu_si128((const __m128i*)(top + i))) : out4;
+                __m128i b = bottom ? colors_sse2(_mm_loadu_si128((const __m128i*)(bottom + i))) : out4;
+                __m128i lo = _mm_unpacklo_epi32(b, t), hi = _mm_unpackhi_epi32(b, t);
+                _mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi64(lo, tail));
+                _mm_storeu_si128((__m128i*)(out + i + 1), _mm_unpackhi_epi64(lo, tail));
+                _mm_storeu_si128((__m128i*)(out + i + 2), _mm_unpacklo_epi64(hi, tail));
+                _mm_storeu_si128((__m128i*)(out + i + 3), _mm_unpackhi_epi64(hi, tail));
+            }
+            resolve_scalar(top ? top + i : NULL, bottom ? bottom + i : NULL, outColor, ch, out + i, n - i);
+        }
+
+        __attribute__((target("sse2")))
+        inline void merge_sse2(const Fragment* below, const Fragment* layer, int key, Fragment* out, size_t n)
+        {
+            const __m128i byte = _mm_set1_epi32(0xFF);
+            const __m128i key4 = _mm_set1_epi32(key >= 0 && key <= 255 ? key : 0x100);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                __m128i l = _mm_loadu_si128((const __m128i*)(layer + i));
+                __m128i b = _mm_loadu_si128((const __m128i*)(below + i));
+                __m128i clear = _mm_or_si128(
+                    _mm_cmpeq_epi32(_mm_and_si128(_mm_srli_epi32(l, 16), byte), _mm_setzero_si128()),
+                    _mm_cmpeq_epi32(_mm_and_si128(l, byte), key4));
+                _mm_storeu_si128((__m128i*)(out + i), _mm_or_si128(_mm_and_si128(clear, b), _mm_andnot_si128(clear, l)));
+            }
+            merge_scalar(below + i, layer + i, key, out + i, n - i);
+        }
+        __attribute__((target("sse2")))
+        inline void transform_sse2(const float* m, const float* xs, const float* ys, float* outX, float* outY, size_t n)
+        {
+            const __m128 a = _mm_set1_ps(m[0]), b = _mm_set1_ps(m[1]), c = _mm_set1_ps(m[2]);
+            const __m128 d = _mm_set1_ps(m[3]), tx = _mm_set1_ps(m[4]), ty = _mm_set1_ps(m[5]);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                // Same order of operations as the scalar loop, so the results match exactly.
+                __m128 x = _mm_loadu_ps(xs + i), y = _mm_loadu_ps(ys + i);
+                _mm_storeu_ps(outX + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(b, y)), tx));
+                _mm_storeu_ps(outY + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(c, x), _mm_mul_ps(d, y)), ty));
+            }
+            transform_scalar(m, xs + i, ys + i, outX + i, outY + i, n - i);
+        }
+        // Dither of 4 pixels as saturating byte offsets, up and down, for the color channels.
+        __attribute__((target("sse2")))
+        inline void dither_sse2(const int8_t* d, __m128i& up, __m128i& down)
+        {
+            auto part = [](int v) { return v > 0 ? v * 0x010101 : 0; };
+            up = _mm_setr_epi32(part(d[0]), part(d[1]), part(d[2]), part(d[3]));
+            down = _mm_setr_epi32(part(-d[0]), part(-d[1]), part(-d[2]), part(-d[3]));
+        }
+        // LUT index of 4 dithered pixels.
+        __attribute__((target("sse2")))
+        inline __m128i lut_index_sse2(__m128i p)
+        {
+            return _mm_or_si128(_mm_or_si128(
+                _mm_and_si128(_mm_srli_epi32(p, 9), _mm_set1_epi32(0x7C00)),
+                _mm_and_si128(_mm_srli_epi32(p, 6), _mm_set1_epi32(0x03E0))),
+                _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0x001F)));
+        }
+        __attribute__((target("sse2")))
+        inline void quantize_sse2(const uint32_t* src, const uint8_t* lut, const int8_t* dither, Fragment* dst, size_t n)
+        {
+            // Groups of 4 alternate between the two halves of the dither pattern.
+            __m128i up[2], down[2];
+            dither_sse2(dither, up[0], down[0]);
+            dither_sse2(dither + 4, up[1], down[1]);
+            const __m128i drawn = _mm_set1_epi32(1 << 16);
+            alignas(16) uint32_t index[4];
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                __m128i p = _mm_loadu_si128((const __m128i*)(src + i));
+                __m128i transparent = _mm_cmpeq_epi32(_mm_srli_epi32(p, 24), _mm_setzero_si128());
+                const int half = (int)(i >> 2 & 1);
+                p = _mm_subs_epu8(_mm_adds_epu8(p, up[half]), down[half]);
+                _mm_store_si128((__m128i*)index, lut_index_sse2(p));
+                // SSE2 has no gather, the lookups are scalar.
+                __m128i color = _mm_setr_epi32(lut[index[0]], lut[index[1]], lut[index[2]], lut[index[3]]);
+                __m128i frag = _mm_or_si128(_mm_or_si128(color, _mm_slli_epi32(color, 8)), drawn);
+                __m128i old = _mm_loadu_si128((const __m128i*)(dst + i));
+                _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(transparent, old), _mm_andnot_si128(transparent, frag)));
+            }
+            quantize_scalar(src + i, lut, dither + (i & 7), dst + i, n - i);
+        }
+
+        __attribute__((target("avx2")))
+        inline void fill_avx2(Fragment* dst, size_t n, Fragment value)
+        {
+            if (n < 8) {
+                fill_sse2(dst, n, value);
+                return;
+            }
+            __m256i v = _mm256_set1_epi32((int)pack_fragment(value));
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16) {
+                _mm256_storeu_si256((__m256i*)(dst + i), v);
+                _mm256_storeu_si256((__m256i*)(dst + i + 8), v);
+            }
+            if (i + 8 <= n)
+                _mm256_storeu_si256((__m256i*)(dst + i), v);
+            _mm256_storeu_si256((__m256i*)(dst + n - 8), v);
+        }
+        __attribute__((target("avx2")))
+        inline __m256i colors_avx2(__m256i frag)
+        {
+            const __m256i byte = _mm256_set1_epi32(0xFF);
+            __m256i unset = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_srli_epi32(frag, 16), byte), _mm256_setzero_si256());
+            __m256i f = _mm256_and_si256(frag, byte);
+            __m256i b = _mm256_and_si256(_mm256_srli_epi32(frag, 8), byte);
+            return _mm256_blendv_epi8(f, b, unset);
+        }
+        __attribute__((target("avx2")))
+        inline void resolve_avx2(const Fragment* top, const Fragment* bottom, uint8_t outColor, wchar_t ch, Cell* out, size_t n)
+        {
+            const __m256i out8 = _mm256_set1_epi32(outColor);
+            const __m256i ch8 = _mm256_set1_epi32((int)ch);
+            size_t i = 0;
+            const __m256i tail = _mm256_unpacklo_epi32(ch8, _mm256_setzero_si256());
+            for (; i + 8 <= n; i += 8)
+            {
+                __m256i t = top ? colors_avx2(_mm256_loadu_si256((const __m256i*)(top + i))) : out8;
+                __m256i b = bottom ? colors_avx2(_mm256_loadu_si256((const __m256i*)(bottom + i))) : out8;
+                // Unpacking works within 128-bit lanes: lo holds f, b of cells 0, 1, 4, 5 and hi of 2, 3, 6, 7.
+                __m256i lo = _mm256_unpacklo_epi32(b, t), hi = _mm256_unpackhi_epi32(b, t);
+                __m256i c04 = _mm256_unpacklo_epi64(lo, tail), c15 = _mm256_unpackhi_epi64(lo, tail);
+                __m256i c26 = _mm256_unpacklo_epi64(hi, tail), c37 = _mm256_unpackhi_epi64(hi, tail);
+                _mm256_storeu_si256((__m256i*)(out + i), _mm256_permute2x128_si256(c04, c15, 0x20));
+                _mm256_storeu_si256((__m256i*)(out + i + 2), _mm256_permute2x128_si256(c26, c37, 0x20));
+                _mm256_storeu_si256((__m256i*)(out + i + 4), _mm256_permute2x128_si256(c04, c15, 0x31));
+                _mm256_storeu_si256((__m256i*)(out + i + 6), _mm256_permute2x128_si256(c26, c37, 0x31));
+            }
+            resolve_sse2(top ? top + i : NULL, bottom ? bottom + i : NULL, outColor, ch, out + i, n - i);
+        }
+        __attribute__((target("avx2")))
+        inline void merge_avx2(const Fragment* below, const Fragment* layer, int key, Fragment* out, size_t n)
+        {
+            const __m256i byte = _mm256_set1_epi32(0xFF);
+            const __m256i key8 = _mm256_set1_epi32(key >= 0 && key <= 255 ? key : 0x100);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                __m256i l = _mm256_loadu_si256((const __m256i*)(layer + i));
+                __m256i b = _mm256_loadu_si256((const __m256i*)(below + i));
+                __m256i clear = _mm256_or_si256(
+                    _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_srli_epi32(l, 16), byte), _mm256_setzero_si256()),
+                    _mm256_cmpeq_epi32(_mm256_and_si256(l, byte), key8));
+                _mm256_storeu_si256((__m256i*)(out + i), _mm256_blendv_epi8(l, b, clear));
+            }
+            merge_sse2(below + i, layer + i, key, out + i, n - i);
+        }
+        __attribute__((target("avx2")))
+        inline void transform_avx2(const float* m, const float* xs, const float* ys, float* outX, float* outY, size_t n)
+        {
+            const __m256 a = _mm256_set1_ps(m[0]), b = _mm256_set1_ps(m[1]), c = _mm256_set1_ps(m[2]);
+            const __m256 d = _mm256_set1_ps(m[3]), tx = _mm256_set1_ps(m[4]), ty = _mm256_set1_ps(m[5]);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                __m256 x = _mm256_loadu_ps(xs + i), y = _mm256_loadu_ps(ys + i);
+                _mm256_storeu_ps(outX + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, x), _mm256_mul_ps(b, y)), tx));
+                _mm256_storeu_ps(outY + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c, x), _mm256_mul_ps(d, y)), ty));
+            }
+            transform_sse2(m, xs + i, ys + i, outX + i, outY + i, n - i);
+        }
+        __attribute__((target("avx2")))
+        inline void quantize_avx2(const uint32_t* src, const uint8_t* lut, const int8_t* dither, Fragment* dst, size_t n)
+        {
+            __m128i up0, down0, up1, down1;
+            dither_sse2(dither, up0, down0);
+            dither_sse2(dither + 4, up1, down1);
+            const __m256i up = _mm256_setr_m128i(up0, up1), down = _mm256_setr_m128i(down0, down1);
+            const __m256i byte = _mm256_set1_epi32(0xFF), drawn = _mm256_set1_epi32(1 << 16);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+            {
+                __m256i p = _mm256_loadu_si256((const __m256i*)(src + i));
+                __m256i transparent = _mm256_cmpeq_epi32(_mm256_srli_epi32(p, 24), _mm256_setzero_si256());
+                p = _mm256_subs_epu8(_mm256_adds_epu8(p, up), down);
+                __m256i index = _mm256_or_si256(_mm256_or_si256(
+                    _mm256_and_si256(_mm256_srli_epi32(p, 9), _mm256_set1_epi32(0x7C00)),
+                    _mm256_and_si256(_mm256_srli_epi32(p, 6), _mm256_set1_epi32(0x03E0))),
+                    _mm256_and_si256(_mm256_srli_epi32(p, 3), _mm256_set1_epi32(0x001F)));
+                // Reads 4 bytes at every index, which is what the padding of the table is for.
+                __m256i color = _mm256_and_si256(_mm256_i32gather_epi32((const int*)lut, index, 1), byte);
+                __m256i frag = _mm256_or_si256(_mm256_or_si256(color, _mm256_slli_epi32(color, 8)), drawn);
+                __m256i old = _mm256_loadu_si256((const __m256i*)(dst + i));
+                _mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(frag, old, transparent));
+            }
+            quantize_sse2(src + i, lut, dither + (i & 7), dst + i, n - i);
+        }
+#endif
+    }
+
+    inline const Kernels& Kernels::Get(SimdLevel wanted)
+    {
+        static const Kernels scalar{ detail::fill_scalar, detail::resolve_scalar, detail::merge_scalar, detail::transform_scalar, detail::quantize_scalar, SimdLevel::Scalar };
+#ifdef CGE_KERNELS_X86
+        static const Kernels sse2{ detail::fill_sse2, detail::resolve_sse2, detail::merge_sse2, detail::transform_sse2, detail::quantize_sse2, SimdLevel::SSE2 };
+        static const Kernels avx2{ detail::fill_avx2, detail::resolve_avx2, detail::merge_avx2, detail::transform_avx2, detail::quantize_avx2, SimdLevel::AVX2 };
+        static const bool hasSSE2 = __builtin_cpu_supports("sse2");
+        static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+        if (wanted >= SimdLevel::AVX2 && hasAVX2)
+            return avx2;
+        if (wanted >= SimdLevel::SSE2 && hasSSE2)
+            return sse2;
+#endif
+        return scalar;
+    }
+    inline const Kernels& Kernels::Best()
+    {
+        static const Kernels& best = Get(SimdLevel::AVX2);
+        return best;
+    }
+
+    // Fills [x0, x1) of row y like Framebuffer::FillSpan(), nothing is clipped.
+    inline void FillSpan(Framebuffer& fb, int x0, int x1, int y, Fragment value)
+    {
+        if (x1 > x0)
+            Kernels::Best().fill(fb.Span(x0, y), (size_t)(x1 - x0), value);
+    }
+    inline void FillAll(Framebuffer& fb, Fragment value)
+    {
+        // Rows are padded to the pitch, filling the padding too makes it one run.
+        Kernels::Best().fill(fb.Data(), (size_t)fb.Pitch() * fb.Height(), value);
+    }
+}
@@ -0,0 +1,174 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "Fragment.hpp"
+#include "DamageRegion.hpp"
+#include "Kernels.hpp"
+
+namespace cge
+{
+    /*
+        One picture of a LayerStack. Pixels without state are transparent, and
+        so are pixels of the key color if the layer has one. Whoever draws into
+        pixels reports it in dirty, and in drawn for what a clear has to wipe.
+    */
+    struct Layer
+    {
+        Framebuffer pixels;
+        DamageRegion dirty;  // changed since the stack was last composed
+        DamageRegion drawn;  // holds something since the layer was last cleared
+        int key = -1;        // transparent color, -1 for none
+        bool visible = true;
+
+        // Makes rectangles of the layer transparent, only what was drawn since the last call.
+        void Clear()
+        {
+            for (const DamageRect& r : drawn.Rects())
+                for (int y = r.y0; y <= r.y1; y++)
+                    FillSpan(pixels, r.x0, r.x1 + 1, y, Fragment{ 0, 0, false });
+            dirty.Add(drawn);
+            drawn.Clear();
+        }
+        void MarkDrawn(int x0, int y0, int x1, int y1)
+        {
+            drawn.Add(x0, y0, x1, y1);
+            dirty.Add(x0, y0, x1, y1);
+        }
+    };
+
+    /*
+        Layers composed bottom to top over a background color. The composite of
+        every prefix of the stack is cached, so a change to a layer only merges
+        it and the layers above it, and only where something changed. Layer 0
+        is the bottom one.
+    */
+    class LayerStack
+    {
+        std::vector<Layer> layers;
+        std::vector<Framebuffer> composites;  // composites[i] is layers 0..i over the background
+        std::vector<Fragment> backgroundRow;
+        DamageRegion redo;
+        uint8_t background = 0;
+        int width = 0, height = 0;
+
+        void merge(size_t i, const DamageRect& r)
+        {
+            const Kernels& kernels = Kernels::Best();
+            const size_t n = (size_t)(r.x1 - r.x0 + 1);
+            const Layer& layer = layers[i];
+            for (int y = r.y0; y <= r.y1; y++)
+            {
+                const Fragment* below = i ? composites[i - 1].Span(r.x0, y) : backgroundRow.data() + r.x0;
+                Fragment* out = composites[i].Span(r.x0, y);
+                if (layer.visible)
+                    kernels.merge(below, layer.pixels.Span(r.x0, y), layer.key, out, n);
+                else
+                    memcpy(out, below, n * sizeof(Fragment));
+            }
+        }
+
+    public:
+        LayerStack(size_t count = 0, uint8_t backgroundColor = 0)
+            : layers(count), composites(count), background(backgroundColor) {}
+
+        // Appends a layer on top and returns its index.
+        size_t Add(int key = -1)
+        {
+            layers.emplace_back();
+            composites.emplace_back();
+            layers.back().key = key;
+            // Lays out the new layer at the current size.
+            int w = width, h = height;
+            width = height = -1;
+            Resize(w, h);
+            return layers.size() - 1;
+        }
+        size_t Count() const { return layers.size(); }
+        Layer& operator[](size_t i) { return layers[i]; }
+        const Layer& operator[](size_t i) const { return layers[i]; }
+        int Width() const { return width; }
+        int Height() const { return height; }
+
+        // Every layer becomes transparent and the whole stack is composed again.
+        void Resize(int w, int h)
+        {
+            if (w == width && h == height)
+                return;
+            width = w;
+            height = h;
+            backgroundRow.assign((size_t)std::max(w, 0), Fragment{ background, background, false });
+            redo.Resize(w, h);
+            for (size_t i = 0; i < layers.size(); i++)
+            {
+                Layer& l = layers[i];
+                l.pixels.Resize(w, h);
+                FillAll(l.pixels, Fragment{ 0, 0, false });
+                composites[i].Resize(w, h);
+                l.dirty.Resize(w, h);
+                l.drawn.Resize(w, h);
+                l.dirty.AddAll();
+            }
+        }
+        void SetVisible(size_t i, bool on)
+        {
+            if (layers[i].visible != on)
+                layers[i].dirty.AddAll();
+            layers[i].visible = on;
+        }
+        void SetKey(size_t i, int key)
+        {
+            if (layers[i].key != key)
+                layers[i].dirty.AddAll();
+            layers[i].key = key;
+        }
+        void SetBackground(uint8_t color)
+        {
+            if (color == background)
+                return;
+            background = color;
+            std::fill(backgroundRow.begin(), backgroundRow.end(), Fragment{ color, color, false });
+            if (!layers.empty())
+                layers[0].dirty.AddAll();
+        }
+
+        /*
+            Brings the cached composites up to date and returns where the top one
+            changed. Layers below the lowest changed one are not touched.
+        */
+        const DamageRegion& Update()
+        {
+            redo.Clear();
+            for (size_t i = 0; i < layers.size(); i++)
+            {
+                // A change shows through every layer above it.
+                redo.Add(layers[i].dirty);
+                layers[i].dirty.Clear();
+                for (const DamageRect& r : redo.Rects())
+                    merge(i, r);
+            }
+            return redo;
+        }
+        // Copies r of the composite into out, which has to have the stack's size.
+        void CopyTo(Framebuffer& out, const DamageRect& r) const
+        {
+            for (int y = r.y0; y <= r.y1; y++)
+            {
+                const Fragment* src = layers.empty() ? backgroundRow.data() + r.x0 : composites.back().Span(r.x0, y);
+                memcpy(out.Span(r.x0, y), src, (size_t)(r.x1 - r.x0 + 1) * sizeof(Fragment));
+            }
+        }
+        // Update() and copies what changed into out, adding it to changed.
+        void Compose(Framebuffer& out, DamageRegion* changed = nullptr)
+        {
+            for (const DamageRect& r : Update().Rects())
+            {
+                CopyTo(out, r);
+                if (changed)
+                    changed->Add(r);
+            }
+        }
+        // Layers 0..i over the background as of the last Update().
+        const Framebuffer& Composite(size_t i) const { return composites[i]; }
+    };
+}
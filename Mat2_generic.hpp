@@ -1,61 +1,56 @@
 #pragma once
 #include <cmath>
+#include <cstddef>
 #include "Vec2_generic.hpp"
 
 namespace cge
 {
+    // Row major, mat[0] mat[1] is the first row.
     template<typename T>
     class Mat2_generic
     {
         T mat[2 * 2];
     public:
 
-        Mat2_generic()
-        {
-            mat[0] = 1; mat[1] = 0;            
-            mat[2] = 0; mat[3] = 1;
-        }
-        Mat2_generic(T c0, T c1, T c2, T c3)
-        {
-            mat[0] = c0; mat[1] = c1;
-            mat[2] = c2; mat[3] = c3;
-        }        
+        constexpr Mat2_generic() : mat{ 1, 0, 0, 1 } {}
+        constexpr Mat2_generic(T c0, T c1, T c2, T c3) : mat{ c0, c1, c2, c3 } {}
 
-        Vec2_generic<T> operator*(const Vec2_generic<T>& v)
+        constexpr Vec2_generic<T> operator*(const Vec2_generic<T>& v) const
         {
             return Vec2_generic<T>(mat[0] * v.x + mat[1] * v.y, mat[2] * v.x + mat[3] * v.y);
         }
-        T operator[](size_t i)
+        constexpr T operator[](std::size_t i) const
         {
             return mat[i];
         }
-        Mat2_generic operator*(const Mat2_generic& rhs)
+        constexpr Mat2_generic operator*(const Mat2_generic& rhs) const
         {
             return Mat2_generic(
                 mat[0]*rhs.mat[0] + mat[1]*rhs.mat[2], mat[0]*rhs.mat[1] + mat[1]*rhs.mat[3],
                 mat[2]*rhs.mat[0] + mat[3]*rhs.mat[2], mat[2]*rhs.mat[1] + mat[3]*rhs.mat[3]
             );
         }
-        Mat2_generic& operator*=(const Mat2_generic& rhs)
+        constexpr Mat2_generic& operator*=(const Mat2_generic& rhs)
         {
-            mat[0] = mat[0]*rhs.mat[0] + mat[1]*rhs.mat[2];
-            mat[1] = mat[0]*rhs.mat[1] + mat[1]*rhs.mat[3];
-            mat[2] = mat[2]*rhs.mat[0] + mat[3]*rhs.mat[2];
-            mat[3] = mat[2]*rhs.mat[1] + mat[3]*rhs.mat[3];
-            return *this;
+            // Every element needs the old values of the others.
+            return *this = *this * rhs;
         }        
+        constexpr T Determinant() const
+        {
+            return mat[0] * mat[3] - mat[1] * mat[2];
+        }
     };
 
     template<typename T>
-    Mat2_generic<T> Rotate(Mat2_generic<T> mat, const float& angle)
+    Mat2_generic<T> Rotate(const Mat2_generic<T>& mat, const T& angle)
     {
-        float s = std::sin(angle);
-        float c = std::cos(angle);
+        T s = std::sin(angle);
+        T c = std::cos(angle);
         return mat * Mat2_generic<T>( c, -s, s, c);
     }
     template<typename T>
-    Mat2_generic<T> Scale(Mat2_generic<T> mat, const Vec2_generic<T>& v)
+    constexpr Mat2_generic<T> Scale(const Mat2_generic<T>& mat, const Vec2_generic<T>& v)
     {
         return mat * Mat2_generic<T>( v.x, 0, 0, v.y);
     }
-}
\ No newline at end of file
+}
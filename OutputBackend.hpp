@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <sys/ioctl.h>
+#include "CellBuffer.hpp"
+
+namespace cge
+{
+    enum class Backend : uint8_t
+    {
+        Curses,         // Through ncurses windows, works everywhere ncurses does.
+        Ansi,           // Escape sequences written straight to the terminal, 256 colors.
+        AnsiTrueColor   // Same as Ansi, colors are sent as 24-bit RGB and RGB pictures keep theirs.
+    };
+
+    /*
+        Receives the cells that changed in a frame and puts them on the screen.
+        Rows and columns are relative to the engine window.
+    */
+    class OutputBackend
+    {
+    public:
+        virtual ~OutputBackend() {}
+        virtual void BeginFrame() {}
+        virtual void PutCells(int row, int x, const Cell* cells, int n) = 0;
+        // False when the frame did not fully reach the terminal, what is on screen is then unknown.
+        virtual bool EndFrame() = 0;
+        // Called when something else drew over the screen, nothing about it can be assumed.
+        virtual void Invalidate() {}
+        // Bytes sent to the terminal by the last frame, 0 when the backend cannot tell.
+        virtual size_t BytesLastFrame() const { return 0; }
+        // Bytes written that the terminal has not read yet, 0 when the backend cannot tell.
+        virtual size_t PendingBytes() const { return 0; }
+        // Asks for cheaper colors while the terminal cannot keep up, backends without a choice ignore it.
+        virtual void SetReducedColor(bool /*on*/) {}
+
+    protected:
+        // Output queued on the tty fd and not yet sent, 0 for anything that is not a tty.
+        static size_t queued_bytes(int fd)
+        {
+            int n = 0;
+            if (ioctl(fd, TIOCOUTQ, &n) != 0 || n < 0)
+                return 0;
+            return (size_t)n;
+        }
+    };
+
+    // Used without a terminal, the presented cells only live in the presenter's snapshot.
+    class HeadlessBackend : public OutputBackend
+    {
+    public:
+        void PutCells(int /*row*/, int /*x*/, const Cell* /*cells*/, int /*n*/) override {}
+        bool EndFrame() override { return true; }
+    };
+}
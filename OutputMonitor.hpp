@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace cge
+{
+    // How far the engine has cut back on output to keep up with a slow terminal.
+    enum class OutputLevel : uint8_t
+    {
+        Normal,         // every frame is presented
+        SkipFrames,     // frames are not presented while earlier output is still queued
+        ReducedColor,   // also sends palette indices instead of 24-bit colors
+        LowRate,        // also presents at most every OutputLimits::lowRateInterval frames
+    };
+
+    struct OutputLimits
+    {
+        size_t highWater = 16384;     // queued bytes that mean the terminal is behind
+        size_t lowWater = 2048;       // queued bytes below which a frame may be presented again
+        float slowPresentMs = 25.0f;  // a present taking longer was blocked by the terminal
+        int escalateAfter = 3;        // behind this many presents in a row goes one level up
+        int recoverAfter = 120;       // keeping up this many presents in a row goes one level down
+        int lowRateInterval = 4;
+        int maxSkipped = 120;         // frames skipped in a row before one is presented anyway
+    };
+
+    /*
+        Watches how the terminal keeps up with what is presented, from the bytes
+        still queued for it after a present and the time the present took, which
+        is spent blocked in write() when the queue is full. Levels go up quickly
+        and down slowly, so a link that is slow now and then does not flicker
+        between them.
+    */
+    class OutputMonitor
+    {
+        OutputLimits limits;
+        OutputLevel level = OutputLevel::Normal;
+        int behind = 0, keepingUp = 0;
+        int skipped = 0;
+        unsigned long lastPresent = 0;
+
+    public:
+        void SetLimits(const OutputLimits& l) { limits = l; }
+        const OutputLimits& Limits() const { return limits; }
+        OutputLevel Level() const { return level; }
+        void Reset()
+        {
+            level = OutputLevel::Normal;
+            behind = keepingUp = skipped = 0;
+        }
+
+        // Whether frame should be presented, with pending bytes still queued for the terminal.
+        bool ShouldPresent(unsigned long frame, size_t pending)
+        {
+            bool present = true;
+            if (level >= OutputLevel::SkipFrames && pending > limits.lowWater)
+                present = false;
+            if (level >= OutputLevel::LowRate && frame - lastPresent < (unsigned long)limits.lowRateInterval)
+                present = false;
+            if (!present && ++skipped < limits.maxSkipped) {
+                // A queue that does not drain is as good as a slow present.
+                if (pending > limits.lowWater)
+                    keepingUp = 0;
+                return false;
+            }
+            skipped = 0;
+            lastPresent = frame;
+            return true;
+        }
+        /*
+            Reports a present that left pending bytes queued and took ms. Returns
+            true when this changed the level.
+        */
+        bool Presented(size_t pending, float ms)
+        {
+            const OutputLevel before = level;
+            if (pending > limits.highWater || ms > limits.slowPresentMs)
+            {
+                keepingUp = 0;
+                if (++behind >= limits.escalateAfter && level < OutputLevel::LowRate) {
+                    level = (OutputLevel)((int)level + 1);
+                    behind = 0;
+                }
+            }
+            else
+            {
+                behind = 0;
+                if (++keepingUp >= limits.recoverAfter && level > OutputLevel::Normal) {
+                    level = (OutputLevel)((int)level - 1);
+                    keepingUp = 0;
+                }
+            }
+            return level != before;
+        }
+    };
+}
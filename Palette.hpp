@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+
+namespace cge
+{
+    /*
+        RGB value (0xRRGGBB) of a color index in the default xterm 256 color
+        palette: 16 system colors, a 6x6x6 color cube and 24 grays.
+    */
+    inline uint32_t PaletteRGB(uint8_t index)
+    {
+        static const uint32_t system[16] = {
+            0x000000, 0xcd0000, 0x00cd00, 0xcdcd00, 0x0000ee, 0xcd00cd, 0x00cdcd, 0xe5e5e5,
+            0x7f7f7f, 0xff0000, 0x00ff00, 0xffff00, 0x5c5cff, 0xff00ff, 0x00ffff, 0xffffff
+        };
+        if (index < 16)
+            return system[index];
+        if (index < 232)
+        {
+            static const uint8_t level[6] = { 0x00, 0x5f, 0x87, 0xaf, 0xd7, 0xff };
+            int i = index - 16;
+            return (uint32_t)level[i / 36] << 16 | (uint32_t)level[i / 6 % 6] << 8 | level[i % 6];
+        }
+        uint32_t g = 8 + (index - 232) * 10;
+        return g << 16 | g << 8 | g;
+    }
+}
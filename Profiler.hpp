@@ -0,0 +1,265 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Building with CGE_PROFILER=0 compiles the timers out, a disabled profiler then costs nothing.
+#ifndef CGE_PROFILER
+#define CGE_PROFILER 1
+#endif
+
+namespace cge
+{
+    // Parts of a frame in Start(), in the order they run.
+    enum class ProfilePhase : uint8_t
+    {
+        Input,      // handle_input()
+        Update,     // OnGameUpdate()
+        Rasterize,  // deferred drawing flushed into the target
+        Resolve,    // back buffer resolved into cells
+        Text,       // strings written over the cells
+        Present,    // cells sent to the terminal, or handed to the presenting thread
+        Wait,       // frame pacing
+        COUNT
+    };
+    enum class ProfileCounter : uint8_t
+    {
+        PairLookups,    // color pairs looked up while presenting
+        PairMisses,     // of those, pairs that had to be defined
+        BytesOut,       // bytes written to the terminal, 0 when the backend cannot tell
+        CellsResolved,  // cells resolved from the back buffer
+        COUNT
+    };
+
+    inline const char* ProfilePhaseName(ProfilePhase p)
+    {
+        static const char* names[] = { "input", "update", "rasterize", "resolve", "text", "present", "wait" };
+        return names[(int)p];
+    }
+    inline const char* ProfileCounterName(ProfileCounter c)
+    {
+        static const char* names[] = { "pair lookups", "pair misses", "bytes out", "cells resolved" };
+        return names[(int)c];
+    }
+
+    struct FrameProfile
+    {
+        static constexpr int PHASES = (int)ProfilePhase::COUNT;
+        static constexpr int COUNTERS = (int)ProfileCounter::COUNT;
+
+        unsigned long frame = 0;
+        int64_t start = 0;                 // ns since the profiler was enabled
+        int64_t duration = 0;              // ns
+        int64_t phaseStart[PHASES] = {};   // ns since the profiler was enabled
+        int64_t phaseTime[PHASES] = {};    // ns, 0 for phases that did not run
+        uint64_t counters[COUNTERS] = {};
+    };
+
+    /*
+        Times the phases of the last HISTORY frames and counts what they did,
+        and keeps the last ZONES named scopes for a trace. Everything runs on
+        the thread that calls Start(), the profiler is not thread safe.
+    */
+    class FrameProfiler
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+        static constexpr size_t HISTORY = 1024;
+        static constexpr size_t ZONES = 8192;
+
+        struct Zone
+        {
+            const char* name;  // has to outlive the profiler, a string literal usually
+            unsigned long frame;
+            int64_t start, duration;
+        };
+
+    private:
+        std::vector<FrameProfile> frames = std::vector<FrameProfile>(HISTORY);
+        std::vector<Zone> zones = std::vector<Zone>(ZONES);
+        size_t nextFrame = 0, frameCount = 0;
+        size_t nextZone = 0, zoneCount = 0;
+        FrameProfile current;
+        Clock::time_point epoch;
+        bool enabled = false;
+        bool inFrame = false;
+
+        static void write_event(FILE* f, bool& first, const char* name, const char* category, int64_t start, int64_t duration)
+        {
+            fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                first ? "" : ",", name, category, start / 1000.0, duration / 1000.0);
+            first = false;
+        }
+
+    public:
+        void SetEnabled(bool on)
+        {
+            if (on && !enabled) {
+                epoch = Clock::now();
+                nextFrame = frameCount = nextZone = zoneCount = 0;
+            }
+            enabled = on && CGE_PROFILER;
+            inFrame = false;
+        }
+        bool Enabled() const { return CGE_PROFILER && enabled; }
+        int64_t Now() const
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+        }
+
+        void BeginFrame(unsigned long frame)
+        {
+            if (!Enabled())
+                return;
+            current = FrameProfile();
+            current.frame = frame;
+            current.start = Now();
+            inFrame = true;
+        }
+        void EndFrame()
+        {
+            if (!Enabled() || !inFrame)
+                return;
+            current.duration = Now() - current.start;
+            frames[nextFrame] = current;
+            nextFrame = (nextFrame + 1) % HISTORY;
+            frameCount = std::min(frameCount + 1, HISTORY);
+            inFrame = false;
+        }
+        // A phase running more than once in a frame adds up.
+        void AddPhase(ProfilePhase p, int64_t start, int64_t end)
+        {
+            if (!inFrame)
+                return;
+            if (!current.phaseTime[(int)p])
+                current.phaseStart[(int)p] = start;
+            current.phaseTime[(int)p] += end - start;
+        }
+        void AddZone(const char* name, int64_t start, int64_t end)
+        {
+            zones[nextZone] = Zone{ name, current.frame, start, end - start };
+            nextZone = (nextZone + 1) % ZONES;
+            zoneCount = std::min(zoneCount + 1, ZONES);
+        }
+        void Count(ProfileCounter c, uint64_t n = 1)
+        {
+            if (Enabled() && inFrame)
+                current.counters[(int)c] += n;
+        }
+
+        // Frames recorded, up to HISTORY, Frame(0) is the oldest.
+        size_t Frames() const { return frameCount; }
+        const FrameProfile& Frame(size_t i) const
+        {
+            return frames[(nextFrame + HISTORY - frameCount + i) % HISTORY];
+        }
+        // Average of the last n frames, frame number and start are those of the latest one.
+        FrameProfile Average(size_t n) const
+        {
+            FrameProfile avg;
+            n = std::min(n, frameCount);
+            if (n == 0)
+                return avg;
+            for (size_t i = frameCount - n; i < frameCount; i++)
+            {
+                const FrameProfile& f = Frame(i);
+                avg.duration += f.duration;
+                for (int p = 0; p < FrameProfile::PHASES; p++)
+                    avg.phaseTime[p] += f.phaseTime[p];
+                for (int c = 0; c < FrameProfile::COUNTERS; c++)
+                    avg.counters[c] += f.counters[c];
+            }
+            avg.duration /= (int64_t)n;
+            for (int p = 0; p < FrameProfile::PHASES; p++)
+                avg.phaseTime[p] /= (int64_t)n;
+            for (int c = 0; c < FrameProfile::COUNTERS; c++)
+                avg.counters[c] /= n;
+            avg.frame = Frame(frameCount - 1).frame;
+            avg.start = Frame(frameCount - 1).start;
+            return avg;
+        }
+
+        /*
+            Writes the recorded frames, phases, zones and counters as a Chrome
+            trace, which chrome://tracing and Perfetto open. False if the file
+            could not be written.
+        */
+        bool WriteChromeTrace(const std::string& path) const
+        {
+            FILE* f = fopen(path.c_str(), "w");
+            if (!f)
+                return false;
+            fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+            bool first = true;
+            char frameName[32];
+            for (size_t i = 0; i < frameCount; i++)
+            {
+                const FrameProfile& fr = Frame(i);
+                snprintf(frameName, sizeof(frameName), "frame %lu", fr.frame);
+                write_event(f, first, frameName, "frame", fr.start, fr.duration);
+                for (int p = 0; p < FrameProfile::PHASES; p++)
+                    if (fr.phaseTime[p])
+                        write_event(f, first, ProfilePhaseName((ProfilePhase)p), "phase", fr.phaseStart[p], fr.phaseTime[p]);
+                fprintf(f, ",\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"args\":{", fr.start / 1000.0);
+                for (int c = 0; c < FrameProfile::COUNTERS; c++)
+                    fprintf(f, "%s\"%s\":%llu", c ? "," : "", ProfileCounterName((ProfileCounter)c), (unsigned long long)fr.counters[c]);
+                fprintf(f, "}}");
+            }
+            for (size_t i = 0; i < zoneCount; i++)
+            {
+                const Zone& z = zones[(nextZone + ZONES - zoneCount + i) % ZONES];
+                write_event(f, first, z.name, "zone", z.start, z.duration);
+            }
+            fprintf(f, "\n]}\n");
+            return fclose(f) == 0;
+        }
+    };
+
+    // Times the scope it lives in as a phase of the current frame.
+    class ScopedPhase
+    {
+        FrameProfiler& profiler;
+        ProfilePhase phase;
+        int64_t start;
+
+    public:
+        ScopedPhase(FrameProfiler& p, ProfilePhase ph) : profiler(p), phase(ph), start(p.Enabled() ? p.Now() : 0) {}
+        ~ScopedPhase()
+        {
+            if (profiler.Enabled())
+                profiler.AddPhase(phase, start, profiler.Now());
+        }
+        ScopedPhase(const ScopedPhase&) = delete;
+        ScopedPhase& operator=(const ScopedPhase&) = delete;
+    };
+    // Times the scope it lives in under a name of its own, it shows up in the trace only.
+    class ScopedZone
+    {
+        FrameProfiler& profiler;
+        const char* name;
+        int64_t start;
+
+    public:
+        ScopedZone(FrameProfiler& p, const char* n) : profiler(p), name(n), start(p.Enabled() ? p.Now() : 0) {}
+        ~ScopedZone()
+        {
+            if (profiler.Enabled())
+                profiler.AddZone(name, start, profiler.Now());
+        }
+        ScopedZone(const ScopedZone&) = delete;
+        ScopedZone& operator=(const ScopedZone&) = delete;
+    };
+}
+
+#define CGE_PROFILE_CONCAT_(a, b) a##b
+#define CGE_PROFILE_CONCAT(a, b) CGE_PROFILE_CONCAT_(a, b)
+#if CGE_PROFILER
+#define CGE_PROFILE_PHASE(profiler, phase) ::cge::ScopedPhase CGE_PROFILE_CONCAT(cgeProfilePhase, __LINE__)(profiler, phase)
+#define CGE_PROFILE_ZONE(profiler, name) ::cge::ScopedZone CGE_PROFILE_CONCAT(cgeProfileZone, __LINE__)(profiler, name)
+#else
+#define CGE_PROFILE_PHASE(profiler, phase) ((void)0)
+#define CGE_PROFILE_ZONE(profiler, name) ((void)0)
+#endif
@@ -0,0 +1,136 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "Fragment.hpp"
+#include "Palette.hpp"
+#include "Kernels.hpp"
+#include "CellBuffer.hpp"
+
+namespace cge
+{
+    /*
+        Pixels as 0xAARRGGBB. Alpha only tells drawn pixels from transparent
+        ones, any alpha but 0 is opaque.
+    */
+    typedef Framebuffer_generic<uint32_t> RGBFramebuffer;
+
+    constexpr uint32_t PackRGB(uint8_t r, uint8_t g, uint8_t b)
+    {
+        return 0xFF000000u | (uint32_t)r << 16 | (uint32_t)g << 8 | b;
+    }
+    constexpr uint32_t RGB_TRANSPARENT = 0;
+
+    /*
+        Nearest palette color for every color with 5 bits per channel, for a
+        terminal with a given number of colors. With 256 colors only the color
+        cube and the grays are used, the first 16 colors differ with every
+        terminal theme.
+    */
+    class QuantizeLUT
+    {
+    public:
+        static constexpr int BITS = 5;
+        static constexpr int SIZE = 1 << (3 * BITS);
+
+    private:
+        std::vector<uint8_t> table;
+        int first, count;
+        int spread;  // dither amplitude, about the distance between neighbouring colors
+
+        QuantizeLUT(int colors)
+        {
+            count = colors >= 256 ? 240 : colors >= 16 ? 16 : 8;
+            first = colors >= 256 ? 16 : 0;
+            spread = colors >= 256 ? 40 : 128;
+            // Padded so a 32-bit gather can read at the last entry.
+            table.assign(SIZE + 3, 0);
+            std::vector<uint32_t> rgb(count);
+            for (int i = 0; i < count; i++)
+                rgb[i] = PaletteRGB((uint8_t)(first + i));
+            for (int i = 0; i < SIZE; i++)
+            {
+                // Middle of the range of colors the entry stands for.
+                int r = (i >> 10 & 31) << 3 | 4, g = (i >> 5 & 31) << 3 | 4, b = (i & 31) << 3 | 4;
+                int best = 0, bestDistance = INT32_MAX;
+                for (int c = 0; c < count && bestDistance; c++)
+                {
+                    int dr = r - (int)(rgb[c] >> 16), dg = g - (int)(rgb[c] >> 8 & 0xFF), db = b - (int)(rgb[c] & 0xFF);
+                    int distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = c;
+                    }
+                }
+                table[i] = (uint8_t)(first + best);
+            }
+        }
+
+    public:
+        // Table for a terminal with colors colors, built on first use.
+        static const QuantizeLUT& For(int colors)
+        {
+            if (colors >= 256) {
+                static const QuantizeLUT lut(256);
+                return lut;
+            }
+            if (colors >= 16) {
+                static const QuantizeLUT lut(16);
+                return lut;
+            }
+            static const QuantizeLUT lut(8);
+            return lut;
+        }
+        const uint8_t* Data() const { return table.data(); }
+        uint8_t Nearest(uint32_t rgb) const
+        {
+            return table[(rgb >> 19 & 31) << 10 | (rgb >> 11 & 31) << 5 | (rgb >> 3 & 31)];
+        }
+        int DitherSpread() const { return spread; }
+    };
+
+    namespace detail
+    {
+        // Dither offset for the pixel in column x of row y, a 4x4 ordered (Bayer) pattern.
+        inline int8_t bayer_offset(int x, int y, const QuantizeLUT& lut)
+        {
+            static const int BAYER[4][4] = {
+                {  0,  8,  2, 10 },
+                { 12,  4, 14,  6 },
+                {  3, 11,  1,  9 },
+                { 15,  7, 13,  5 }
+            };
+            return (int8_t)((BAYER[y & 3][x & 3] * 2 - 15) * lut.DitherSpread() / 32);
+        }
+    }
+
+    /*
+        Quantizes n pixels of src into dst, which start at column x of row y.
+        With dither a 4x4 ordered (Bayer) pattern trades banding in gradients
+        for a fine, stable texture.
+    */
+    inline void QuantizeRow(const uint32_t* src, Fragment* dst, size_t n, int x, int y, const QuantizeLUT& lut, bool dither)
+    {
+        int8_t offsets[16] = {};
+        if (dither)
+            for (int i = 0; i < 16; i++)
+                offsets[i] = detail::bayer_offset(x + i, y, lut);
+        Kernels::Best().quantize(src, lut.Data(), offsets, dst, n);
+    }
+
+    /*
+        Palette color to show a cell color as on a terminal without RGB. x and y
+        place the color in the dither pattern, take the cell column and twice
+        the cell row, plus one for the foreground.
+    */
+    inline uint8_t CellPaletteColor(uint32_t color, const QuantizeLUT& lut, int x, int y)
+    {
+        if (!(color & CELL_RGB))
+            return (uint8_t)color;
+        if (!(color & CELL_DITHER))
+            return lut.Nearest(color);
+        int d = detail::bayer_offset(x, y, lut);
+        auto channel = [d](uint32_t c) { return (uint32_t)std::clamp((int)(c & 0xFF) + d, 0, 255); };
+        return lut.Nearest(channel(color >> 16) << 16 | channel(color >> 8) << 8 | channel(color));
+    }
+}
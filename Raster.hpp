@@ -0,0 +1,245 @@
+#pragma once
+#include <cmath>
+#include <climits>
+#include <vector>
+#include <algorithm>
+
+/*
+    Rasterization of the primitives. Outlines call plot(x, y) per pixel, filled
+    primitives call span(x0, x1, y) once per covered row with inclusive ends and
+    their spans never overlap. Filled primitives only visit rows rowMin..rowMax,
+    other clipping is up to the caller.
+*/
+namespace cge
+{
+    namespace detail
+    {
+        inline int clamp_int(long long v) { return (int)std::clamp<long long>(v, INT_MIN, INT_MAX); }
+        // Row offsets dy0..dy1 of center_y - r..center_y + r within rowMin..rowMax, false if there are none.
+        inline bool clip_rows(int center_y, int r, int rowMin, int rowMax, int& dy0, int& dy1)
+        {
+            long long lo = std::max(-(long long)r, (long long)rowMin - center_y);
+            long long hi = std::min((long long)r, (long long)rowMax - center_y);
+            if (lo > hi)
+                return false;
+            dy0 = (int)lo;
+            dy1 = (int)hi;
+            return true;
+        }
+        // Smallest and largest |dy| for dy in dy0..dy1.
+        inline void abs_range(int dy0, int dy1, int& a, int& b)
+        {
+            a = dy0 <= 0 && dy1 >= 0 ? 0 : std::min(std::abs(dy0), std::abs(dy1));
+            b = std::max(std::abs(dy0), std::abs(dy1));
+        }
+    }
+
+    template<typename Plot>
+    void LinePixels(int x0, int y0, int x1, int y1, Plot&& plot)
+    {
+        /* Use of Bresenham's line algorithm. */
+        int dx = std::abs(x1 - x0);
+        int sx = x0 < x1 ? 1 : -1;
+        int dy = -std::abs(y1 - y0);
+        int sy = y0 < y1 ? 1 : -1;
+        int err = dx + dy;
+
+        while (true)
+        {
+            plot(x0, y0);
+            if (x0 == x1 && y0 == y1) break;
+            int e2 = 2 * err;
+            if (e2 >= dy) {
+                err += dy;
+                x0 += sx;
+            }
+            if (e2 <= dx) {
+                err += dx;
+                y0 += sy;
+            }
+        }
+    }
+
+    template<typename Plot>
+    void CirclePixels(int center_x, int center_y, int r, Plot&& plot)
+    {
+        /* Use of Bresenham's circle algorithm. */
+        auto plot_8 = [&](int x, int y) {
+            plot(center_x + x, center_y + y);
+            plot(center_x - x, center_y + y);
+            plot(center_x + x, center_y - y);
+            plot(center_x - x, center_y - y);
+            plot(center_x + y, center_y + x);
+            plot(center_x - y, center_y + x);
+            plot(center_x + y, center_y - x);
+            plot(center_x - y, center_y - x);
+        };
+        int x = 0, y = r;
+        int d = 3 - 2 * r;
+        plot_8(x, y);
+        while (y >= x)
+        {
+            x++;
+            if (d > 0) {
+                y--;
+                d = d + 4 * (x - y) + 10;
+            }
+            else
+                d = d + 4 * x + 6;
+            plot_8(x, y);
+        }
+    }
+
+    // Two corners.
+    template<typename Plot>
+    void RectanglePixels(int x0, int y0, int x1, int y1, Plot&& plot)
+    {
+        int x, y;
+        int xi = (x1 - x0) > 0 ? 1 : -1;
+        int yi = (y1 - y0) > 0 ? 1 : -1;
+
+        for (x = x0; x != x1 + xi; x += xi) {
+            plot(x, y0);
+            plot(x, y1);
+        }
+        for (y = y0; y != y1 + yi; y += yi) {
+            plot(x0, y);
+            plot(x1, y);
+        }
+    }
+
+    // Two corners, in any order.
+    template<typename Span>
+    void FillRectangleSpans(int x0, int y0, int x1, int y1, Span&& span, int rowMin = INT_MIN, int rowMax = INT_MAX)
+    {
+        if (x0 > x1) std::swap(x0, x1);
+        if (y0 > y1) std::swap(y0, y1);
+        y0 = std::max(y0, rowMin);
+        y1 = std::min(y1, rowMax);
+        // Counting in long long, y1 may be INT_MAX.
+        for (long long y = y0; y <= y1; y++)
+            span(x0, x1, (int)y);
+    }
+
+    /*
+        Half width of the rows of a circle with radius r, for row offsets a..b
+        with 0 <= a <= b <= r, hw[0] being the row at offset a. Follows the same
+        Bresenham path as the outline, so fill and outline match.
+    */
+    inline const std::vector<int>& circle_half_widths(int r, int a, int b)
+    {
+        static thread_local std::vector<int> hw;
+        hw.assign(b - a + 1, -1);
+        int x = 0, y = r;
+        long long d = 3 - 2 * (long long)r;
+        auto mark = [&](int x, int y) {
+            if (a <= x && x <= b && y >= 0) hw[x - a] = std::max(hw[x - a], y);
+            if (a <= y && y <= b && x <= r) hw[y - a] = std::max(hw[y - a], x);
+        };
+        mark(x, y);
+        // Past these the path only marks rows outside a..b.
+        while (y >= x && x <= b && (long long)y + 1 >= a)
+        {
+            x++;
+            if (d > 0) {
+                y--;
+                d = d + 4 * (long long)(x - y) + 10;
+            }
+            else
+                d = d + 4 * (long long)x + 6;
+            mark(x, y);
+        }
+        return hw;
+    }
+
+    template<typename Span>
+    void FillCircleSpans(int center_x, int center_y, int r, Span&& span, int rowMin = INT_MIN, int rowMax = INT_MAX)
+    {
+        int dy0, dy1, a, b;
+        if (r < 0 || !detail::clip_rows(center_y, r, rowMin, rowMax, dy0, dy1))
+            return;
+        detail::abs_range(dy0, dy1, a, b);
+        const std::vector<int>& hw = circle_half_widths(r, a, b);
+        for (long long dy = dy0; dy <= dy1; dy++)
+        {
+            int w = hw[std::abs(dy) - a];
+            if (w >= 0)
+                span(detail::clamp_int((long long)center_x - w), detail::clamp_int((long long)center_x + w), center_y + (int)dy);
+        }
+    }
+
+    /*
+        Circle sector from startAngle to endAngle in radians. Angles are measured
+        from the +x axis towards +y, which is clockwise on screen.
+    */
+    template<typename Span>
+    void FillPieSpans(int center_x, int center_y, int r, float startAngle, float endAngle, Span&& span, int rowMin = INT_MIN, int rowMax = INT_MAX)
+    {
+        const float TAU = 6.28318530718f;
+        const float EPS = 1e-3f;
+        float sweep = endAngle - startAngle;
+        if (r < 0 || sweep == 0.0f)
+            return;
+        if (std::abs(sweep) >= TAU) {
+            FillCircleSpans(center_x, center_y, r, span, rowMin, rowMax);
+            return;
+        }
+        if (sweep < 0) {
+            std::swap(startAngle, endAngle);
+            sweep = -sweep;
+        }
+
+        // Above half a turn the pie is the circle minus the (convex) remaining wedge.
+        bool inverted = sweep > TAU / 2;
+        float a0 = inverted ? endAngle : startAngle;
+        float a1 = inverted ? startAngle + TAU : endAngle;
+        float sx = std::cos(a0), sy = std::sin(a0);
+        float ex = std::cos(a1), ey = std::sin(a1);
+        // Boundary pixels belong to the pie, so the removed wedge is shrunk slightly.
+        float eps = inverted ? -EPS : EPS;
+
+        // Intersects [lo, hi] with the points where a * px + c >= 0.
+        auto half_plane = [](float a, float c, float& lo, float& hi) {
+            if (a > 0) lo = std::max(lo, -c / a);
+            else if (a < 0) hi = std::min(hi, -c / a);
+            else if (c < 0) hi = lo - 1;
+        };
+
+        int dy0, dy1, a, b;
+        if (!detail::clip_rows(center_y, r, rowMin, rowMax, dy0, dy1))
+            return;
+        detail::abs_range(dy0, dy1, a, b);
+        const std::vector<int>& hw = circle_half_widths(r, a, b);
+        auto at = [center_x](int dx) { return detail::clamp_int((long long)center_x + dx); };
+        for (long long row = dy0; row <= dy1; row++)
+        {
+            const int dy = (int)row;
+            int w = hw[std::abs(dy) - a];
+            if (w < 0)
+                continue;
+            // Wedge between the two rays: cross(s, p) >= 0 and cross(p, e) >= 0.
+            float lo = -w - 1.0f, hi = w + 1.0f;
+            half_plane(-sy, sx * dy + eps, lo, hi);
+            half_plane(ey, -ex * dy + eps, lo, hi);
+            // Rays close to horizontal put the bounds far out, past what fits an int.
+            lo = std::min(std::max(lo, -w - 1.0f), w + 1.0f);
+            hi = std::min(std::max(hi, -w - 1.0f), w + 1.0f);
+            int wl = detail::clamp_int((long long)std::ceil(lo)), wh = detail::clamp_int((long long)std::floor(hi));
+
+            if (!inverted) {
+                wl = std::max(wl, -w);
+                wh = std::min(wh, w);
+                if (wl <= wh)
+                    span(at(wl), at(wh), center_y + dy);
+            }
+            else if (wl > wh || wh < -w || wl > w)
+                span(at(-w), at(w), center_y + dy);
+            else {
+                if (wl > -w)
+                    span(at(-w), at(wl - 1), center_y + dy);
+                if (wh < w)
+                    span(at(wh + 1), at(w), center_y + dy);
+            }
+        }
+    }
+}
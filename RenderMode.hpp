@@ -0,0 +1,144 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include "CellBuffer.hpp"
+#include "Palette.hpp"
+
+namespace cge
+{
+    /*
+        How pixels are packed into character cells. HalfBlock shows 1x2 pixels
+        per cell in two colors exactly. The others show 2x2, 2x3 and 2x4 pixels
+        per cell with block, sextant and braille characters. A cell has only
+        two colors, so with more colors in a cell the others are drawn in
+        whichever of the two is closer.
+    */
+    enum class RenderMode : uint8_t { HalfBlock, Quadrant, Sextant, Braille };
+
+    constexpr int CellWidth(RenderMode mode) { return mode == RenderMode::HalfBlock ? 1 : 2; }
+    constexpr int CellHeight(RenderMode mode)
+    {
+        return mode == RenderMode::Sextant ? 3 : mode == RenderMode::Braille ? 4 : 2;
+    }
+
+    /*
+        Character for each mask of foreground pixels of a cell, bit y * 2 + x
+        for the pixel in column x and row y of the cell.
+    */
+    inline const std::array<wchar_t, 256>& GlyphTable(RenderMode mode)
+    {
+        static const std::array<wchar_t, 256> halfBlock = [] {
+            std::array<wchar_t, 256> t{};
+            const wchar_t glyphs[4] = { L' ', L'▀', L'▄', L'█' };
+            for (int m = 0; m < 256; m++)
+                t[m] = glyphs[m & 3];
+            return t;
+        }();
+        static const std::array<wchar_t, 256> quadrant = [] {
+            std::array<wchar_t, 256> t{};
+            const wchar_t glyphs[16] = {
+                L' ', L'▘', L'▝', L'▀', L'▖', L'▌', L'▞', L'▛',
+                L'▗', L'▚', L'▐', L'▜', L'▄', L'▙', L'▟', L'█'
+            };
+            for (int m = 0; m < 256; m++)
+                t[m] = glyphs[m & 15];
+            return t;
+        }();
+        static const std::array<wchar_t, 256> sextant = [] {
+            std::array<wchar_t, 256> t{};
+            for (int m = 0; m < 256; m++)
+            {
+                int s = m & 63;
+                // U+1FB00 onwards skips the masks that already have block characters.
+                if (s == 0)
+                    t[m] = L' ';
+                else if (s == 21)
+                    t[m] = L'▌';
+                else if (s == 42)
+                    t[m] = L'▐';
+                else if (s == 63)
+                    t[m] = L'█';
+                else
+                    t[m] = (wchar_t)(0x1FB00 + s - 1 - (s > 21) - (s > 42));
+            }
+            return t;
+        }();
+        static const std::array<wchar_t, 256> braille = [] {
+            std::array<wchar_t, 256> t{};
+            // Braille dots are numbered down the left column first, the bottom row last.
+            const uint8_t dot[8] = { 0x01, 0x08, 0x02, 0x10, 0x04, 0x20, 0x40, 0x80 };
+            for (int m = 0; m < 256; m++)
+            {
+                int bits = 0;
+                for (int i = 0; i < 8; i++)
+                    if (m >> i & 1)
+                        bits |= dot[i];
+                t[m] = (wchar_t)(0x2800 + bits);
+            }
+            return t;
+        }();
+        switch (mode)
+        {
+            case RenderMode::Quadrant: return quadrant;
+            case RenderMode::Sextant: return sextant;
+            case RenderMode::Braille: return braille;
+            default: return halfBlock;
+        }
+    }
+
+    namespace detail
+    {
+        inline int color_distance(uint32_t a, uint32_t b)
+        {
+            uint32_t x = CellColorRGB(a), y = CellColorRGB(b);
+            int dr = (int)(x >> 16) - (int)(y >> 16);
+            int dg = (int)(x >> 8 & 0xFF) - (int)(y >> 8 & 0xFF);
+            int db = (int)(x & 0xFF) - (int)(y & 0xFF);
+            return dr * dr + dg * dg + db * db;
+        }
+    }
+
+    /*
+        Cell for n <= 8 pixel colors of a cell, row by row, as cell colors. The
+        most common color becomes the background and the next most common the
+        foreground.
+    */
+    inline Cell ResolveBlock(const uint32_t* colors, int n, const std::array<wchar_t, 256>& glyphs)
+    {
+        uint32_t bg = colors[0], fg = colors[0];
+        int bgCount = 0, fgCount = 0;
+        for (int i = 0; i < n; i++)
+        {
+            uint32_t c = colors[i];
+            // Counting each color at its first pixel, later ones were counted already.
+            bool seen = false;
+            for (int j = 0; j < i && !seen; j++)
+                seen = colors[j] == c;
+            if (seen)
+                continue;
+            int count = 1;
+            for (int j = i + 1; j < n; j++)
+                count += colors[j] == c;
+            if (count > bgCount) {
+                fg = bg;
+                fgCount = bgCount;
+                bg = c;
+                bgCount = count;
+            }
+            else if (count > fgCount) {
+                fg = c;
+                fgCount = count;
+            }
+        }
+        if (fgCount == 0)
+            return Cell{ bg, bg, L' ' };
+        int mask = 0;
+        for (int i = 0; i < n; i++)
+        {
+            uint32_t c = colors[i];
+            if (c == fg || (c != bg && detail::color_distance(c, fg) < detail::color_distance(c, bg)))
+                mask |= 1 << i;
+        }
+        return Cell{ fg, bg, glyphs[mask] };
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "Fragment.hpp"
+
+namespace cge
+{
+    enum class SpriteFlip : uint8_t { None = 0, X = 1, Y = 2, XY = 3 };
+
+    /*
+        Palette indexed pixels owned by someone else, row by row with stride
+        bytes between rows. Pixels equal to key are transparent.
+    */
+    struct SpriteView
+    {
+        const uint8_t* pixels = nullptr;
+        int width = 0;
+        int height = 0;
+        int stride = 0;
+        uint8_t key = 0;
+
+        const uint8_t* Row(int y) const { return pixels + (size_t)y * stride; }
+        uint8_t At(int x, int y) const { return Row(y)[x]; }
+        bool Empty() const { return width <= 0 || height <= 0; }
+    };
+
+    // A SpriteView that owns its pixels.
+    class Sprite
+    {
+        std::vector<uint8_t> pixels;
+        int width = 0;
+        int height = 0;
+
+    public:
+        uint8_t key = 0;
+
+        Sprite() {}
+        Sprite(int w, int h, uint8_t transparent = 0)
+            : pixels((size_t)w * h, transparent), width(w), height(h), key(transparent) {}
+
+        int Width() const { return width; }
+        int Height() const { return height; }
+        uint8_t* Row(int y) { return pixels.data() + (size_t)y * width; }
+        uint8_t& At(int x, int y) { return pixels[(size_t)y * width + x]; }
+        uint8_t At(int x, int y) const { return pixels[(size_t)y * width + x]; }
+        SpriteView View() const { return SpriteView{ pixels.data(), width, height, width, key }; }
+        operator SpriteView() const { return View(); }
+    };
+
+    /*
+        Draws s with its top left corner at x, y, every sprite pixel becoming a
+        scale x scale block. Only the part inside the inclusive clip rectangle
+        is touched, which has to lie within fb. Works row by row over the
+        visible part, so clipped pixels cost nothing.
+    */
+    inline void BlitSprite(Framebuffer& fb, const SpriteView& s, int x, int y, SpriteFlip flip, int scale,
+                           int cx0, int cy0, int cx1, int cy1)
+    {
+        if (s.Empty() || scale < 1)
+            return;
+        const int w = s.width * scale, h = s.height * scale;
+        const int x0 = std::max(x, cx0), x1 = std::min(x + w - 1, cx1);
+        const int y0 = std::max(y, cy0), y1 = std::min(y + h - 1, cy1);
+        if (x0 > x1 || y0 > y1)
+            return;
+        const bool flipX = (uint8_t)flip & (uint8_t)SpriteFlip::X;
+        const bool flipY = (uint8_t)flip & (uint8_t)SpriteFlip::Y;
+
+        for (int py = y0; py <= y1; py++)
+        {
+            int sy = (py - y) / scale;
+            const uint8_t* src = s.Row(flipY ? s.height - 1 - sy : sy);
+            Fragment* dst = fb.Span(0, py);
+            if (scale == 1 && !flipX)
+            {
+                for (int px = x0; px <= x1; px++)
+                {
+                    uint8_t c = src[px - x];
+                    if (c != s.key)
+                        dst[px] = Fragment{ c, c, true };
+                }
+                continue;
+            }
+            for (int px = x0; px <= x1; px++)
+            {
+                int sx = (px - x) / scale;
+                uint8_t c = src[flipX ? s.width - 1 - sx : sx];
+                if (c != s.key)
+                    dst[px] = Fragment{ c, c, true };
+            }
+        }
+    }
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ByteOrder.hpp"
+#include "Sprite.hpp"
+
+namespace cge
+{
+    /*
+        Read-only set of sprites in one file that is mapped into memory, so
+        opening it reads nothing but the header and pixels are paged in when
+        first drawn. Little-endian layout:
+
+            header   "CGEA", u32 version (1), u32 count, u32 reserved
+            entries  count times: char name[20] (NUL padded), u16 width,
+                     u16 height, u32 offset of the pixels from the file start,
+                     u8 transparent key, 3 bytes padding; sorted by name
+            pixels   width * height palette indices per sprite, row by row
+    */
+    class SpriteAtlas
+    {
+    public:
+        static constexpr size_t NAME_LENGTH = 20;
+
+    private:
+        static constexpr size_t HEADER_SIZE = 16;
+        static constexpr size_t ENTRY_SIZE = 32;
+        static constexpr uint32_t VERSION = 1;
+
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        uint32_t count = 0;
+
+        uint32_t read(size_t at, int bytes) const { return (uint32_t)LoadLE(data + at, bytes); }
+        const char* entry_name(size_t i) const
+        {
+            return reinterpret_cast<const char*>(data + HEADER_SIZE + i * ENTRY_SIZE);
+        }
+
+    public:
+        SpriteAtlas() {}
+        SpriteAtlas(const SpriteAtlas&) = delete;
+        SpriteAtlas& operator=(const SpriteAtlas&) = delete;
+        ~SpriteAtlas() { Close(); }
+
+        // False if the file cannot be mapped or is not an atlas.
+        bool Open(const std::string& path)
+        {
+            Close();
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            void* map = MAP_FAILED;
+            if (fstat(fd, &st) == 0 && (size_t)st.st_size >= HEADER_SIZE)
+                map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            // The mapping stays valid without the descriptor.
+            close(fd);
+            if (map == MAP_FAILED)
+                return false;
+
+            data = static_cast<const uint8_t*>(map);
+            size = st.st_size;
+            count = read(8, 4);
+            if (memcmp(data, "CGEA", 4) != 0 || read(4, 4) != VERSION || HEADER_SIZE + (size_t)count * ENTRY_SIZE > size) {
+                Close();
+                return false;
+            }
+            return true;
+        }
+        void Close()
+        {
+            if (data)
+                munmap(const_cast<uint8_t*>(data), size);
+            data = nullptr;
+            size = 0;
+            count = 0;
+        }
+        bool IsOpen() const { return data != nullptr; }
+        size_t Count() const { return count; }
+
+        std::string_view Name(size_t i) const
+        {
+            if (i >= count)
+                return {};
+            const char* name = entry_name(i);
+            return std::string_view(name, strnlen(name, NAME_LENGTH));
+        }
+        // Empty view for a bad index or an entry pointing outside of the file.
+        SpriteView Get(size_t i) const
+        {
+            if (i >= count)
+                return SpriteView();
+            size_t at = HEADER_SIZE + i * ENTRY_SIZE + NAME_LENGTH;
+            int w = (int)read(at, 2), h = (int)read(at + 2, 2);
+            size_t offset = read(at + 4, 4);
+            if (offset > size || (size_t)w * h > size - offset)
+                return SpriteView();
+            return SpriteView{ data + offset, w, h, w, data[at + 8] };
+        }
+        // Binary search over the sorted names, empty view if there is no such sprite.
+        SpriteView Find(std::string_view name) const
+        {
+            size_t lo = 0, hi = count;
+            while (lo < hi)
+            {
+                size_t mid = (lo + hi) / 2;
+                std::string_view n = Name(mid);
+                if (n == name)
+                    return Get(mid);
+                if (n < name)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return SpriteView();
+        }
+
+        /*
+            Writes sprites as an atlas file. Names longer than NAME_LENGTH are cut,
+            sprites larger than 65535 pixels in either direction are rejected.
+        */
+        static bool Write(const std::string& path, std::vector<std::pair<std::string, SpriteView>> sprites)
+        {
+            std::sort(sprites.begin(), sprites.end(), [](const auto& a, const auto& b) {
+                return a.first.substr(0, NAME_LENGTH) < b.first.substr(0, NAME_LENGTH);
+            });
+            std::vector<uint8_t> header(HEADER_SIZE + sprites.size() * ENTRY_SIZE, 0);
+            memcpy(header.data(), "CGEA", 4);
+            StoreLE(header.data() + 4, VERSION, 4);
+            StoreLE(header.data() + 8, sprites.size(), 4);
+            size_t offset = header.size();
+            for (size_t i = 0; i < sprites.size(); i++)
+            {
+                const SpriteView& s = sprites[i].second;
+                if (s.width < 0 || s.height < 0 || s.width > 0xFFFF || s.height > 0xFFFF || offset > UINT32_MAX)
+                    return false;
+                uint8_t* e = header.data() + HEADER_SIZE + i * ENTRY_SIZE;
+                memcpy(e, sprites[i].first.data(), std::min(sprites[i].first.size(), NAME_LENGTH));
+                StoreLE(e + NAME_LENGTH, (uint64_t)s.width, 2);
+                StoreLE(e + NAME_LENGTH + 2, (uint64_t)s.height, 2);
+                StoreLE(e + NAME_LENGTH + 4, offset, 4);
+                e[NAME_LENGTH + 8] = s.key;
+                offset += (size_t)s.width * s.height;
+            }
+
+            FILE* f = fopen(path.c_str(), "wb");
+            if (!f)
+                return false;
+            bool ok = fwrite(header.data(), 1, header.size(), f) == header.size();
+            for (const auto& [name, s] : sprites)
+                for (int y = 0; ok && y < s.height; y++)
+                    ok = fwrite(s.Row(y), 1, s.width, f) == (size_t)s.width;
+            return fclose(f) == 0 && ok;
+        }
+    };
+}
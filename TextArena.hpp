@@ -0,0 +1,131 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include "ringqueue.hpp"
+
+namespace cge
+{
+    /*
+        Decodes UTF-8 into out, which must have room for n characters. Malformed
+        sequences become U+FFFD. Returns the number of characters written.
+    */
+    inline size_t DecodeUTF8(const char* s, size_t n, wchar_t* out)
+    {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(s);
+        const unsigned char* end = p + n;
+        size_t count = 0;
+        while (p < end)
+        {
+            uint32_t c = *p++;
+            if (c < 0x80) {
+                out[count++] = (wchar_t)c;
+                continue;
+            }
+            int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : -1;
+            if (extra < 0 || c > 0xF4 || end - p < extra) {
+                out[count++] = 0xFFFD;
+                continue;
+            }
+            c &= 0x3F >> extra;
+            int i = 0;
+            for (; i < extra && (p[i] & 0xC0) == 0x80; i++)
+                c = c << 6 | (p[i] & 0x3F);
+            static const uint32_t MIN[4] = { 0, 0x80, 0x800, 0x10000 };
+            if (i < extra || c < MIN[extra] || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+                out[count++] = 0xFFFD;
+                p += i;
+                continue;
+            }
+            out[count++] = (wchar_t)c;
+            p += extra;
+        }
+        return count;
+    }
+
+    // A string queued for drawing, its characters live in the TextArena.
+    struct TextRun
+    {
+        uint32_t offset;
+        uint32_t length;
+        int x, y;  // character cell
+        bool alpha;
+        uint8_t f;
+    };
+
+    /*
+        Per-frame storage for the strings drawn in that frame. Characters are bump
+        allocated from one buffer and runs are queued, both may happen on several
+        threads at once, but not while Reset() runs: it may replace the buffer.
+        Once the buffer has grown to what a frame needs, drawing text does not
+        allocate.
+    */
+    class TextArena
+    {
+        std::unique_ptr<wchar_t[]> chars;
+        size_t capacity;
+        std::atomic<size_t> used{ 0 };
+        std::atomic<size_t> overflow{ 0 };  // characters of the strings that did not fit this frame
+        mpsc_queue<TextRun> runs;
+
+    public:
+        TextArena(size_t initialChars = 1 << 14, size_t maxRuns = 4096)
+            : chars(new wchar_t[initialChars]), capacity(initialChars), runs(maxRuns) {}
+
+        /*
+            Reserves n characters and stores their offset. Returns NULL when they
+            do not fit in what is left, the next Reset() makes room for them.
+            Smaller strings may still fit after that.
+        */
+        wchar_t* Allocate(size_t n, uint32_t& offset)
+        {
+            size_t at = used.load(std::memory_order_relaxed);
+            do {
+                if (n > capacity - at) {
+                    overflow.fetch_add(n, std::memory_order_relaxed);
+                    return NULL;
+                }
+            } while (!used.compare_exchange_weak(at, at + n, std::memory_order_relaxed));
+            offset = (uint32_t)at;
+            return chars.get() + at;
+        }
+        // Takes back the unused end of the latest allocation if nothing was allocated since.
+        void Shrink(uint32_t offset, size_t allocated, size_t kept)
+        {
+            size_t expected = offset + allocated;
+            used.compare_exchange_strong(expected, offset + kept, std::memory_order_relaxed);
+        }
+        // False when too many runs were queued this frame.
+        bool Submit(TextRun run)
+        {
+            return runs.push(std::move(run));
+        }
+        const wchar_t* Chars(const TextRun& run) const { return chars.get() + run.offset; }
+        // Moves up to max queued runs into out.
+        size_t Drain(TextRun* out, size_t max)
+        {
+            return runs.pop_all(out, max);
+        }
+        /*
+            Forgets this frame's characters. Grows the buffer if the frame asked
+            for more than it had, which frees the old one, so no Allocate() may be
+            in progress and no run may be left undrained.
+        */
+        void Reset()
+        {
+            size_t wanted = used.load(std::memory_order_relaxed) + overflow.load(std::memory_order_relaxed);
+            if (wanted > capacity)
+            {
+                while (capacity < wanted)
+                    capacity = capacity ? capacity * 2 : 1;
+                chars.reset(new wchar_t[capacity]);
+            }
+            used.store(0, std::memory_order_relaxed);
+            overflow.store(0, std::memory_order_relaxed);
+        }
+        size_t Capacity() const { return capacity; }
+        // Characters allocated this frame.
+        size_t Used() const { return used.load(std::memory_order_relaxed); }
+    };
+}
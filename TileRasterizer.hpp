@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "DrawCommand.hpp"
+#include "JobPool.hpp"
+
+namespace cge
+{
+    /*
+        Records draw calls and rasterizes them later, split into screen tiles.
+        Every tile is rasterized by one thread of a JobPool from start to end, so
+        the framebuffer needs no locking, and within a tile the commands keep the
+        order they were recorded in.
+    */
+    class TileRasterizer
+    {
+    public:
+        static constexpr int TILE_W = 64;
+        static constexpr int TILE_H = 32;
+
+    private:
+        std::vector<DrawCommand> commands;
+        std::vector<std::vector<uint32_t>> bins;  // command indices per tile
+        std::vector<uint32_t> busy;               // tiles that have commands
+        int width = 0, height = 0;
+        int tilesX = 0, tilesY = 0;
+        unsigned threads = 0;
+        std::unique_ptr<JobPool> pool;
+
+        void bin()
+        {
+            for (uint32_t i = 0; i < commands.size(); i++)
+            {
+                const DrawCommand& c = commands[i];
+                int tx0 = std::max(c.left, 0) / TILE_W, tx1 = std::min(c.right, width - 1) / TILE_W;
+                int ty0 = std::max(c.top, 0) / TILE_H, ty1 = std::min(c.bottom, height - 1) / TILE_H;
+                if (c.right < 0 || c.bottom < 0 || c.left >= width || c.top >= height)
+                    continue;
+                for (int ty = ty0; ty <= ty1; ty++)
+                    for (int tx = tx0; tx <= tx1; tx++)
+                    {
+                        std::vector<uint32_t>& b = bins[ty * tilesX + tx];
+                        if (b.empty())
+                            busy.push_back(ty * tilesX + tx);
+                        b.push_back(i);
+                    }
+            }
+        }
+        void raster_tile(Framebuffer& fb, int tile)
+        {
+            const int cx0 = tile % tilesX * TILE_W, cy0 = tile / tilesX * TILE_H;
+            const int cx1 = std::min(cx0 + TILE_W, width) - 1, cy1 = std::min(cy0 + TILE_H, height) - 1;
+
+            for (uint32_t i : bins[tile])
+                RasterizeCommand(commands[i], fb, cx0, cy0, cx1, cy1);
+        }
+
+    public:
+        // Threads used by Flush(), including the calling one. 0 uses every hardware thread.
+        void SetThreads(unsigned n)
+        {
+            threads = n;
+            pool.reset();
+        }
+        unsigned Threads() const { return pool ? pool->Threads() : threads; }
+        size_t Pending() const { return commands.size(); }
+
+        void Add(const DrawCommand& c) { commands.push_back(c); }
+        void Clear(uint8_t color)
+        {
+            commands.push_back(DrawCommand::Clear(0, 0, width - 1, height - 1, color));
+        }
+
+        // Size of the framebuffers that will be flushed into, drops anything recorded.
+        void Resize(int w, int h)
+        {
+            width = w;
+            height = h;
+            tilesX = (width + TILE_W - 1) / TILE_W;
+            tilesY = (height + TILE_H - 1) / TILE_H;
+            bins.assign((size_t)tilesX * tilesY, std::vector<uint32_t>());
+            busy.clear();
+            commands.clear();
+        }
+        // Rasterizes everything recorded since the last flush into fb, which has the size given to Resize().
+        void Flush(Framebuffer& fb)
+        {
+            if (commands.empty())
+                return;
+            if (!pool)
+                pool = std::make_unique<JobPool>(threads);
+
+            bin();
+            pool->Run(busy.size(), [&](size_t i) { raster_tile(fb, busy[i]); });
+
+            for (uint32_t t : busy)
+                bins[t].clear();
+            busy.clear();
+            commands.clear();
+        }
+    };
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+namespace cge
+{
+    /*
+        Hands values from one producer thread to one consumer thread without either
+        of them ever waiting. The producer fills Back() and publishes it, the consumer
+        takes the newest published value into Front(). A value published before the
+        consumer took the previous one replaces it, so the older one is dropped.
+    */
+    template<typename T>
+    class TripleBuffer
+    {
+        static constexpr uint8_t FRESH = 4;
+
+        T buffers[3];
+        std::atomic<uint8_t> middle{ 1 };  // index of the buffer in between, FRESH when not taken yet
+        uint8_t back = 0;
+        uint8_t front = 2;
+
+    public:
+        // Producer side.
+        T& Back() { return buffers[back]; }
+        // Which of the three buffers Back() is, it changes with every Publish().
+        int BackIndex() const { return back; }
+        // Returns true when the previously published value was dropped unseen.
+        bool Publish()
+        {
+            uint8_t old = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+            back = old & 3;
+            return old & FRESH;
+        }
+
+        // Consumer side.
+        T& Front() { return buffers[front]; }
+        bool HasNew() const { return middle.load(std::memory_order_acquire) & FRESH; }
+        // Moves the newest published value into Front(), false if there was none.
+        bool Acquire()
+        {
+            if (!HasNew())
+                return false;
+            uint8_t old = middle.exchange(front, std::memory_order_acq_rel);
+            front = old & 3;
+            return true;
+        }
+
+        // Not thread safe, for setting all three buffers up.
+        T& operator[](int i) { return buffers[i]; }
+    };
+}
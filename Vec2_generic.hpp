@@ -1,5 +1,7 @@
 #pragma once
 #include <cmath>
+#include <cstddef>
+#include <string>
 
 namespace cge
 {
@@ -9,72 +11,84 @@ namespace cge
         T x = 0;
         T y = 0;        
 
-        Vec2_generic() {}
-        Vec2_generic(const Vec2_generic& v) : x(v.x), y(v.y) {}
-        Vec2_generic(const T& x, const T& y) : x(x), y(y) {}
-        Vec2_generic(const T& val) : x(val), y(val) {}
-        //Vec2f(float x, float y) : x(x), y(y) {}
+        constexpr Vec2_generic() {}
+        constexpr Vec2_generic(const Vec2_generic& v) = default;
+        constexpr Vec2_generic(const T& x, const T& y) : x(x), y(y) {}
+        constexpr Vec2_generic(const T& val) : x(val), y(val) {}
+        Vec2_generic& operator=(const Vec2_generic& v) = default;
 
-        T Mag() { return std::sqrt(x * x + y * y); }
-        Vec2_generic Round() { return Vec2_generic(std::round(this->x), std::round(this->y)); }
-        Vec2_generic Normalized() {
+        T Mag() const { return std::sqrt(x * x + y * y); }
+        Vec2_generic Round() const { return Vec2_generic(std::round(this->x), std::round(this->y)); }
+        Vec2_generic Normalized() const {
             T mag = Mag();
             if (mag == 0)
                 return Vec2_generic(0, 0);
             return Vec2_generic(x / mag, y / mag);
         }
 
-        Vec2_generic operator+(const Vec2_generic& v)
+        constexpr Vec2_generic operator+(const Vec2_generic& v) const
         {
             return Vec2_generic(this->x + v.x, this->y + v.y);
         }
-        Vec2_generic& operator+=(const Vec2_generic& rhs)
+        constexpr Vec2_generic& operator+=(const Vec2_generic& rhs)
         {
             this->x += rhs.x;
             this->y += rhs.y;
             return *this;
         }
-        T operator*(const Vec2_generic& rhs)
+        // Dot product.
+        constexpr T operator*(const Vec2_generic& rhs) const
         {
-            return this->x * rhs.x + this->y + rhs.y;
+            return this->x * rhs.x + this->y * rhs.y;
         }
-        Vec2_generic operator*(const T& rhs)
+        constexpr Vec2_generic operator*(const T& rhs) const
         {
             return Vec2_generic(this->x * rhs, this->y * rhs);
         }        
-        Vec2_generic& operator*=(const T& rhs)
+        constexpr Vec2_generic& operator*=(const T& rhs)
         {
             this->x *= rhs;
             this->y *= rhs;
             return *this;
         }
-        Vec2_generic operator-(const Vec2_generic& rhs)
+        constexpr Vec2_generic operator-(const Vec2_generic& rhs) const
         {
             return Vec2_generic(this->x - rhs.x, this->y - rhs.y);
         }
-        Vec2_generic& operator-=(const Vec2_generic& rhs)
+        constexpr Vec2_generic operator-() const
+        {
+            return Vec2_generic(-this->x, -this->y);
+        }
+        constexpr Vec2_generic& operator-=(const Vec2_generic& rhs)
         {
             this->x -= rhs.x;
             this->y -= rhs.y;
             return *this;
         }
-        T& operator[](std::size_t i)
+        constexpr bool operator==(const Vec2_generic& rhs) const { return x == rhs.x && y == rhs.y; }
+        constexpr bool operator!=(const Vec2_generic& rhs) const { return !(*this == rhs); }
+        // 0 is x, 1 is y.
+        constexpr T& operator[](std::size_t i)
+        {
+            return i == 0 ? x : y;
+        }
+        constexpr const T& operator[](std::size_t i) const
         {
-            return *((float*)this + i);
+            return i == 0 ? x : y;
         }
-        std::string to_string()
+        std::string to_string() const
         {
             return "[" + std::to_string(x) + ";" + std::to_string(y) + "]";
         }
-        std::wstring to_wstring()
+        std::wstring to_wstring() const
         {
             return L"[" + std::to_wstring(x) + ";" + std::to_wstring(y) + "]";
         }    
 
     };
     template<class T>
-    Vec2_generic<T> operator*(const T& lhs, const Vec2_generic<T>& rhs)
+    constexpr Vec2_generic<T> operator*(const T& lhs, const Vec2_generic<T>& rhs)
     {
         return Vec2_generic<T>(lhs * rhs.x, lhs * rhs.y);
     }
-}
\ No newline at end of file
+}
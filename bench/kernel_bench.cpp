@@ -0,0 +1,272 @@
+/*
+    Times the framebuffer kernels against the plain loops they replaced:
+    clearing the whole buffer, filling short spans, resolving pixels into
+    cells, merging a layer over another, transforming points and quantizing
+    RGB pixels. Every kernel level is checked against the plain loop first.
+
+    Usage: kernel_bench [width] [height in pixels] [repeats]
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "Kernels.hpp"
+#include "Affine2_generic.hpp"
+#include "Quantize.hpp"
+
+using cge::Cell;
+using cge::Fragment;
+using cge::Framebuffer;
+
+template<typename F>
+double time_ms(int repeats, F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++)
+        f(i);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+}
+
+// The loops as the engine had them.
+void plain_clear(Framebuffer& fb, Fragment v)
+{
+    for (int y = 0; y < fb.Height(); y++)
+        for (int x = 0; x < fb.Width(); x++)
+            fb(x, y) = v;
+}
+void plain_resolve(const Framebuffer& fb, std::vector<Cell>& cells, uint8_t outColor)
+{
+    int rows = (fb.Height() + 1) / 2;
+    for (int row = 0; row < rows; row++)
+    {
+        const Fragment* t = fb.Row(row * 2);
+        const Fragment* b = row * 2 + 1 < fb.Height() ? fb.Row(row * 2 + 1) : NULL;
+        Cell* c = cells.data() + (size_t)row * fb.Width();
+        for (int x = 0; x < fb.Width(); x++)
+        {
+            c[x].f = b ? b[x].GetColor() : outColor;
+            c[x].b = t[x].GetColor();
+            c[x].ch = L'▄';
+        }
+    }
+}
+void kernel_resolve(const cge::Kernels& k, const Framebuffer& fb, std::vector<Cell>& cells, uint8_t outColor)
+{
+    int rows = (fb.Height() + 1) / 2;
+    for (int row = 0; row < rows; row++)
+    {
+        const Fragment* b = row * 2 + 1 < fb.Height() ? fb.Row(row * 2 + 1) : NULL;
+        k.resolve(fb.Row(row * 2), b, outColor, L'▄', cells.data() + (size_t)row * fb.Width(), fb.Width());
+    }
+}
+
+void plain_merge(const Framebuffer& below, const Framebuffer& layer, int key, Framebuffer& out)
+{
+    for (int y = 0; y < out.Height(); y++)
+        for (int x = 0; x < out.Width(); x++)
+            out(x, y) = layer(x, y).state && layer(x, y).f != key ? layer(x, y) : below(x, y);
+}
+void kernel_merge(const cge::Kernels& k, const Framebuffer& below, const Framebuffer& layer, int key, Framebuffer& out)
+{
+    for (int y = 0; y < out.Height(); y++)
+        k.merge(below.Row(y), layer.Row(y), key, out.Row(y), out.Width());
+}
+
+int main(int argc, char** argv)
+{
+    int width = argc > 1 ? atoi(argv[1]) : 3840;
+    int height = argc > 2 ? atoi(argv[2]) : 2160;
+    int repeats = argc > 3 ? atoi(argv[3]) : 50;
+    const char* names[] = { "scalar", "sse2", "avx2" };
+
+    Framebuffer fb(width, height);
+    uint32_t seed = 1;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            seed = seed * 1103515245 + 12345;
+            fb(x, y) = Fragment{ (uint8_t)(seed >> 8), (uint8_t)(seed >> 16), (seed >> 24 & 1) != 0 };
+        }
+    std::vector<Cell> expected((size_t)width * ((height + 1) / 2)), cells(expected.size());
+    plain_resolve(fb, expected, 7);
+
+    printf("%d x %d pixels, %d repeats\n", width, height, repeats);
+    double plain = time_ms(repeats, [&](int) { plain_resolve(fb, cells, 7); });
+    printf("%-8s resolve %8.3f ms\n", "plain", plain);
+    for (int level = 0; level < 3; level++)
+    {
+        const cge::Kernels& k = cge::Kernels::Get((cge::SimdLevel)level);
+        if ((int)k.level != level) {
+            printf("%-8s not supported\n", names[level]);
+            continue;
+        }
+        kernel_resolve(k, fb, cells, 7);
+        for (size_t i = 0; i < cells.size(); i++)
+            if (cells[i] != expected[i]) {
+                printf("%-8s resolve differs at cell %zu\n", names[level], i);
+                return 1;
+            }
+        double ms = time_ms(repeats, [&](int) { kernel_resolve(k, fb, cells, 7); });
+        printf("%-8s resolve %8.3f ms  %5.2fx\n", names[level], ms, plain / ms);
+    }
+
+    // Merging needs a second picture, the first one reversed will do.
+    Framebuffer layer(width, height), merged(width, height), mergedExpected(width, height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            layer(x, y) = fb(width - 1 - x, height - 1 - y);
+    plain_merge(fb, layer, 5, mergedExpected);
+    plain = time_ms(repeats, [&](int) { plain_merge(fb, layer, 5, merged); });
+    printf("%-8s merge   %8.3f ms\n", "plain", plain);
+    for (int level = 0; level < 3; level++)
+    {
+        const cge::Kernels& k = cge::Kernels::Get((cge::SimdLevel)level);
+        if ((int)k.level != level)
+            continue;
+        kernel_merge(k, fb, layer, 5, merged);
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                if (memcmp(&merged(x, y), &mergedExpected(x, y), 3) != 0) {
+                    printf("%-8s merge differs at %d, %d\n", names[level], x, y);
+                    return 1;
+                }
+        double ms = time_ms(repeats, [&](int) { kernel_merge(k, fb, layer, 5, merged); });
+        printf("%-8s merge   %8.3f ms  %5.2fx\n", names[level], ms, plain / ms);
+    }
+
+    Fragment v{ 3, 3, false };
+    plain = time_ms(repeats, [&](int) { plain_clear(fb, v); });
+    printf("%-8s clear   %8.3f ms\n", "plain", plain);
+    for (int level = 0; level < 3; level++)
+    {
+        const cge::Kernels& k = cge::Kernels::Get((cge::SimdLevel)level);
+        if ((int)k.level != level)
+            continue;
+        double ms = time_ms(repeats, [&](int) { k.fill(fb.Data(), (size_t)fb.Pitch() * fb.Height(), v); });
+        printf("%-8s clear   %8.3f ms  %5.2fx\n", names[level], ms, plain / ms);
+    }
+
+    // Short spans at odd offsets, like filled circles and rectangles produce.
+    const int SPANS = 200000;
+    plain = time_ms(repeats, [&](int r) {
+        for (int i = 0; i < SPANS; i++)
+        {
+            int y = (i * 7 + r) % height, x0 = (i * 13) % (width - 64);
+            fb.FillSpan(x0, x0 + 1 + i % 61, y, v);
+        }
+    });
+    printf("%-8s spans   %8.3f ms\n", "plain", plain);
+    for (int level = 0; level < 3; level++)
+    {
+        const cge::Kernels& k = cge::Kernels::Get((cge::SimdLevel)level);
+        if ((int)k.level != level)
+            continue;
+        double ms = time_ms(repeats, [&](int r) {
+            for (int i = 0; i < SPANS; i++)
+            {
+                int y = (i * 7 + r) % height, x0 = (i * 13) % (width - 64);
+                k.fill(fb.Span(x0, y), 1 + i % 61, v);
+            }
+        });
+        printf("%-8s spans   %8.3f ms  %5.2fx\n", names[level], ms, plain / ms);
+    }
+
+    // Points one at a time as vectors, against the same points as separate x and y arrays.
+    const size_t POINTS = 1 << 16;
+    typedef cge::Vec2_generic<float> Vec2f;
+    cge::Affine2_generic<float> m = cge::Affine2_generic<float>::Rotation(0.3f, Vec2f(100, 50));
+    float c[6];
+    m.Coefficients(c);
+    std::vector<Vec2f> points(POINTS), moved(POINTS);
+    std::vector<float> xs(POINTS), ys(POINTS), outX(POINTS), outY(POINTS);
+    for (size_t i = 0; i < POINTS; i++)
+    {
+        points[i] = Vec2f((float)(i % 977), (float)(i % 331));
+        xs[i] = points[i].x;
+        ys[i] = points[i].y;
+    }
+    plain = time_ms(repeats, [&](int) {
+        for (size_t i = 0; i < POINTS; i++)
+            moved[i] = m * points[i];
+    });
+    printf("%-8s points  %8.3f ms\n", "plain", plain);
+    for (int level = 0; level < 3; level++)
+    {
+        const cge::Kernels& k = cge::Kernels::Get((cge::SimdLevel)level);
+        if ((int)k.level != level)
+            continue;
+        k.transform(c, xs.data(), ys.data(), outX.data(), outY.data(), POINTS);
+        for (size_t i = 0; i < POINTS; i++)
+            if (outX[i] != moved[i].x || outY[i] != moved[i].y) {
+                printf("%-8s points differ at %zu\n", names[level], i);
+                return 1;
+            }
+        double ms = time_ms(repeats, [&](int) { k.transform(c, xs.data(), ys.data(), outX.data(), outY.data(), POINTS); });
+        printf("%-8s points  %8.3f ms  %5.2fx\n", names[level], ms, plain / ms);
+    }
+
+    // RGB pixels to palette colors, the plain loop searches the palette for every pixel.
+    cge::RGBFramebuffer rgb(width, height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            seed = seed * 1103515245 + 12345;
+            rgb(x, y) = (seed >> 8 & 15) ? cge::PackRGB(x * 255 / width, y * 255 / height, seed >> 16) : cge::RGB_TRANSPARENT;
+        }
+    const cge::QuantizeLUT& lut = cge::QuantizeLUT::For(256);
+    Framebuffer quantized(width, height), quantizedExpected(width, height);
+    plain = time_ms(1, [&](int) {
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+            {
+                uint32_t p = rgb(x, y);
+                int best = 16, bestDistance = INT32_MAX;
+                for (int c = 16; c < 256; c++)
+                {
+                    uint32_t q = cge::PaletteRGB((uint8_t)c);
+                    int dr = (int)(p >> 16 & 0xFF) - (int)(q >> 16), dg = (int)(p >> 8 & 0xFF) - (int)(q >> 8 & 0xFF), db = (int)(p & 0xFF) - (int)(q & 0xFF);
+                    if (dr * dr + dg * dg + db * db < bestDistance) {
+                        bestDistance = dr * dr + dg * dg + db * db;
+                        best = c;
+                    }
+                }
+                if (p >> 24)
+                    quantized(x, y) = Fragment{ (uint8_t)best, (uint8_t)best, true };
+            }
+    });
+    printf("%-8s rgb     %8.3f ms\n", "search", plain);
+    for (bool dither : { false, true })
+    {
+        auto run = [&](const cge::Kernels& k, Framebuffer& out) {
+            int8_t offsets[16] = {};
+            for (int y = 0; y < height; y++)
+            {
+                if (dither)
+                    for (int i = 0; i < 16; i++)
+                        offsets[i] = (int8_t)((i * 5 + y * 3) % 31 - 15);
+                k.quantize(rgb.Row(y), lut.Data(), offsets, out.Row(y), width);
+            }
+        };
+        // Transparent pixels keep what was there, both start out the same.
+        FillAll(quantizedExpected, Fragment{ 0, 0, false });
+        run(cge::Kernels::Get(cge::SimdLevel::Scalar), quantizedExpected);
+        for (int level = 0; level < 3; level++)
+        {
+            const cge::Kernels& k = cge::Kernels::Get((cge::SimdLevel)level);
+            if ((int)k.level != level)
+                continue;
+            FillAll(quantized, Fragment{ 0, 0, false });
+            run(k, quantized);
+            for (int y = 0; y < height; y++)
+                for (int x = 0; x < width; x++)
+                    if (memcmp(&quantized(x, y), &quantizedExpected(x, y), 3) != 0) {
+                        printf("%-8s rgb differs at %d, %d\n", names[level], x, y);
+                        return 1;
+                    }
+            double ms = time_ms(repeats, [&](int) { run(k, quantized); });
+            printf("%-8s rgb%s %8.3f ms  %5.0fx\n", names[level], dither ? " dith" : "     ", ms, plain / ms);
+        }
+    }
+    return 0;
+}
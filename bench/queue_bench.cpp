@@ -0,0 +1,89 @@
+/*
+    Compares the mutex based tsqueue with the lock-free spsc_queue and
+    mpsc_queue. Producers push a fixed number of items, one consumer drains
+    them, the time until everything arrived is reported.
+
+    Usage: queue_bench [items per producer] [producers]
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tsqueue.hpp"
+#include "ringqueue.hpp"
+
+// Roughly what DrawString() queues per call.
+struct Item
+{
+    std::wstring str;
+    int x, y;
+};
+
+template<typename Push, typename Pop>
+double run(int producers, long items, Push push, Pop pop)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++)
+        threads.emplace_back([&, p] {
+            for (long i = 0; i < items; i++)
+            {
+                Item item{ L"Rectangle         1", (int)i, p };
+                while (!push(item))
+                    std::this_thread::yield();
+            }
+        });
+
+    long left = items * producers;
+    while (left > 0)
+    {
+        long n = pop();
+        if (n == 0)
+            std::this_thread::yield();
+        left -= n;
+    }
+    for (auto& t : threads)
+        t.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const char* name, int producers, long items, double seconds)
+{
+    printf("%-22s %d producer(s)  %8.3f ms  %7.2f Mitems/s\n", name, producers, seconds * 1000.0,
+        items * producers / seconds / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    long items = argc > 1 ? atol(argv[1]) : 1000000;
+    int producers = argc > 2 ? atoi(argv[2]) : 4;
+    const size_t CAPACITY = 4096;
+
+    for (int p : { 1, producers })
+    {
+        cge::tsqueue<Item> ts;
+        report("tsqueue", p, items, run(p, items,
+            [&](Item& i) { ts.push(i); return true; },
+            [&]() -> long { return ts.pop() ? 1 : 0; }));
+
+        cge::mpsc_queue<Item> mpsc(CAPACITY);
+        std::vector<Item> batch(256);
+        report("mpsc_queue pop_all", p, items, run(p, items,
+            [&](Item& i) { return mpsc.push(std::move(i)); },
+            [&]() -> long { return mpsc.pop_all(batch.data(), batch.size()); }));
+    }
+
+    cge::spsc_queue<Item> spsc(CAPACITY);
+    std::vector<Item> batch(256);
+    report("spsc_queue pop_all", 1, items, run(1, items,
+        [&](Item& i) { return spsc.push(std::move(i)); },
+        [&]() -> long { return spsc.pop_all(batch.data(), batch.size()); }));
+
+    cge::spsc_queue<Item> spsc2(CAPACITY);
+    report("spsc_queue try_pop", 1, items, run(1, items,
+        [&](Item& i) { return spsc2.push(std::move(i)); },
+        [&]() -> long { return spsc2.try_pop() ? 1 : 0; }));
+    return 0;
+}
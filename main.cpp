@@ -1,40 +1,142 @@
 #include <iostream>
 #include <cstdio>
 #include <cmath>
+#include <cstring>
 #include "CursesGameEngine.hpp"
 #include "Mat2_generic.hpp"
+#include "SpriteAtlas.hpp"
+#include "CanvasFile.hpp"
+#include "CanvasHistory.hpp"
 
 
 using cge::Vec2f;
 typedef cge::Mat2_generic<float> Mat2f;
 
-struct Shape
-{
-    uint8_t color;
-    Vec2f p0, p1;
-    int mode;
-};
-
 class TestGame : public cge::CursesGameEngine
 {
     Vec2f center;
 public:
     TestGame() {}
+    // Frame timing differs from run to run, headless runs hide it to keep checksums stable.
+    bool showTiming = true;
+    // Mode icons are taken from this atlas, which is created from the built-in ones if missing.
+    string atlasPath;
+    // The picture is loaded from here at start and saved back every few seconds when it changed.
+    string canvasPath;
+
+    // Fills the scene with n pseudo random shapes, the same ones every run.
+    void GenerateScene(int n)
+    {
+        uint32_t seed = 12345;
+        auto next = [&](int max) {
+            seed = seed * 1103515245 + 12345;
+            return (int)((seed >> 8) % max);
+        };
+        for (int i = 0; i < n; i++)
+        {
+            Vec2f a(next(WinWidth()), next(WinHeight()));
+            Vec2f b(a.x + next(41) - 20, a.y + next(41) - 20);
+            uint8_t color = (uint8_t)(1 + next(255));
+            canvas.Add(ShapeCommand(a, b, 1 + next(3), color));
+        }
+    }
 private:
     bool run = true;
+    // Angle rectangles are drawn at, in radians.
     float rotate = 0.0f;
-    vector<Shape> shapes;
+    static constexpr float ROTATE_STEP = 3.14159265f / 12.0f;
+    // Committed shapes, rasterized once instead of every frame.
+    cge::DisplayList canvas;
+    // A loaded picture, the canvas, the shape being drawn and the mode icon, each redrawn only when it changes.
+    enum { BACKGROUND_LAYER, CANVAS_LAYER, PREVIEW_LAYER, HUD_LAYER };
+    cge::LayerStack layers{ 4, COLOR_BLACK };
+    bool previewChanged = true;
+    int hudMode = 0;  // mode the HUD layer shows
     MEVENT mEvent;
     bool draw = false;
     Vec2f p0, p1;
     uint8_t rectColor = 1;
     int mode = 1;
+    cge::OutputLevel outputLevel = cge::OutputLevel::Normal;
+    static constexpr const char* ICON_NAMES[3] = { "rectangle", "circle", "line" };
+    cge::Sprite icons[3];
+    cge::SpriteView iconViews[3];
+    cge::SpriteAtlas atlas;
+    // Rows of the loaded picture are decoded as they are shown, a few per frame.
+    static constexpr int LOAD_ROWS_PER_FRAME = 16;
+    cge::CanvasFile loaded;
+    cge::DamageRegion loadedRows;
+    bool loading = false;
+    // Autosaving writes a few rows per frame, so a large canvas does not stall the frame.
+    static constexpr float AUTOSAVE_SECONDS = 5.0f;
+    static constexpr int SAVE_ROWS_PER_FRAME = 32;
+    cge::CanvasWriter autosave;
+    float sinceSave = 0.0f;
+    unsigned long edits = 0, savedEdits = 0, savingEdits = 0;  // changes to the picture, saved ones, ones being saved
+    bool saveRequested = false;
+    // Undo history of the picture, started over whenever the picture changes by other means than an edit.
+    cge::CanvasHistory history{ 32u << 20 };
+    cge::DamageRegion edited, restored;  // edited since the last commit, restored by undo or redo
+    bool historyStale = true;
+    int historyMoves = 0;  // redo steps asked for, undo steps if negative
+    // Heatmap pasted into the picture with 'h', dithered down to the terminal's colors.
+    cge::RGBFramebuffer heatmap;
+    bool pasteHeatmap = false;
+
+    void MakeIcons()
+    {
+        for (int i = 0; i < 3; i++)
+            icons[i] = cge::Sprite(9, 9, COLOR_BLACK);
+        auto plot = [](cge::Sprite& s) { return [&s](int x, int y) { s.At(x, y) = COLOR_WHITE; }; };
+        cge::RectanglePixels(0, 1, 8, 7, plot(icons[0]));
+        cge::CirclePixels(4, 4, 4, plot(icons[1]));
+        cge::LinePixels(0, 8, 8, 0, plot(icons[2]));
+        for (int i = 0; i < 3; i++)
+            iconViews[i] = icons[i];
+    }
+    // Smooth made up data in a blue, cyan, green, yellow, red color map.
+    void MakeHeatmap(int w, int h)
+    {
+        static const uint8_t stops[5][3] = { { 0, 0, 255 }, { 0, 255, 255 }, { 0, 255, 0 }, { 255, 255, 0 }, { 255, 0, 0 } };
+        heatmap.Resize(w, h);
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+            {
+                float v = 0.5f + 0.25f * std::sin(x * 0.08f) + 0.25f * std::cos(y * 0.11f + x * 0.02f);
+                float at = std::clamp(v, 0.0f, 1.0f) * 4.0f;
+                int i = std::min((int)at, 3);
+                float t = at - i;
+                auto mix = [&](int c) { return (uint8_t)(stops[i][c] + (stops[i + 1][c] - stops[i][c]) * t); };
+                heatmap(x, y) = cge::PackRGB(mix(0), mix(1), mix(2));
+            }
+    }
+    void LoadIcons()
+    {
+        if (!atlas.Open(atlasPath)) {
+            std::vector<std::pair<string, cge::SpriteView>> sprites;
+            for (int i = 0; i < 3; i++)
+                sprites.emplace_back(ICON_NAMES[i], iconViews[i]);
+            if (!cge::SpriteAtlas::Write(atlasPath, sprites) || !atlas.Open(atlasPath))
+                return;
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            cge::SpriteView v = atlas.Find(ICON_NAMES[i]);
+            if (!v.Empty())
+                iconViews[i] = v;
+        }
+    }
 
 protected:
     bool OnGameStart() override
     {
         center.x = WinWidth() / 2;
         center.y = WinHeight() / 2;
+        MakeIcons();
+        if (!atlasPath.empty())
+            LoadIcons();
+        if (!canvasPath.empty())
+            loaded.Open(canvasPath);
 
         return true;        
     }
@@ -43,12 +145,31 @@ protected:
         switch(key)
         {
             case 'x': run = false; break;
-            case 'c': shapes.clear(); break;
+            case 'c':
+                canvas.Clear();
+                layers[BACKGROUND_LAYER].Clear();
+                loaded.Close();
+                loading = false;
+                edited.AddAll();
+                edits++;
+                break;
+            case 's': saveRequested = true; break;
+            case 'u': historyMoves--; break;
+            case 'r': historyMoves++; break;
             case 49: mode = 1; break;
             case 50: mode = 2; break;
             case 51: mode = 3; break;
+            case 'q': rotate -= ROTATE_STEP; break;
+            case 'e': rotate += ROTATE_STEP; break;
+            case 'p': SetProfilerOverlay(!ProfilerOverlay()); break;
+            case 'h': pasteHeatmap = true; break;
             default: break;
         }
+        previewChanged = true;
+    }
+    void OnOutputDegraded(cge::OutputLevel level) override
+    {
+        outputLevel = level;
     }
     void OnMouseEvent(int x, int y, mmask_t bstate) override
     {        
@@ -65,7 +186,14 @@ protected:
         else if (bstate == BUTTON1_RELEASED)
         {
             draw = false;
-            shapes.push_back(Shape{rectColor, p0, p1, mode});
+            if (mode == 1 && rotate != 0.0f)
+                AddRotatedRectangle();
+            else {
+                cge::DrawCommand shape = ShapeCommand(p0, p1, mode, rectColor);
+                canvas.Add(shape);
+                edited.Add(shape.left, shape.top, shape.right, shape.bottom);
+            }
+            edits++;
         }
         else if (bstate == BUTTON4_PRESSED)
         {
@@ -80,71 +208,356 @@ protected:
             p1.x = x;
             p1.y = y;
         }
+        previewChanged = true;
     }    
     bool OnGameUpdate(float delta) override
     {
-        Clear(COLOR_BLACK);
-        
-        for (auto r : shapes)
+        // Layers start out empty at a new size.
+        if (layers.Width() != WinWidth() || layers.Height() != WinHeight()) {
+            layers.Resize(WinWidth(), WinHeight());
+            for (cge::DamageRegion* r : { &loadedRows, &edited, &restored })
+                r->Resize(WinWidth(), WinHeight());
+            loaded.Unload();
+            historyStale = true;
+            previewChanged = true;
+            hudMode = 0;
+        }
+        // What gets saved has to be loaded completely.
+        if (loaded.IsOpen())
+            LoadRows(saveRequested ? WinHeight() : LOAD_ROWS_PER_FRAME);
+        if (pasteHeatmap)
+            PasteHeatmap();
+        SetDrawTarget(layers, CANVAS_LAYER);
+        DrawDisplayList(canvas);
+        if (previewChanged)
         {
-            if (r.mode == 1) {
-                DrawRectangle(r.p0.x, r.p0.y, r.p1.x, r.p1.y, r.color);
-            }
-            else if (r.mode == 2) {
-                DrawCircle(r.p0.x, r.p0.y, (r.p1 - r.p0).Mag(), r.color);
-            }
-            else if (r.mode == 3) {
-                DrawLine(r.p0.x, r.p0.y, r.p1.x, r.p1.y, r.color);
-            }
+            SetDrawTarget(layers, PREVIEW_LAYER);
+            Clear(COLOR_BLACK);
+            DrawPreview();
+            previewChanged = false;
         }
-        if (draw)
+        if (hudMode != mode)
         {
-            if (mode == 1) {
-                DrawRectangle(p0.x, p0.y, p1.x, p1.y, rectColor);
-                DrawLine(p0.x, p0.y, p1.x, p1.y, COLOR_BLUE);
-            }
-            else if (mode == 2) {
-                DrawCircle(p0.x, p0.y, (p1 - p0).Mag(), rectColor);
-                DrawLine(p0.x, p0.y, p1.x, p1.y, COLOR_BLUE);
-            }
-            else if (mode == 3) {
-                DrawLine(p0.x, p0.y, p1.x, p1.y, rectColor);
-            }
-            DrawString(0, 1 * 2, "Drawing... p0" + p0.to_string() + " p1" + p1.to_string(), COLOR_GREEN);            
+            SetDrawTarget(layers, HUD_LAYER);
+            Clear(COLOR_BLACK);
+            DrawSprite(iconViews[mode - 1], 22 * CellWidth(), 4 * CellHeight() - 1);
+            hudMode = mode;
+        }
+        ResetDrawTarget();
+        {
+            CGE_PROFILE_ZONE(GetProfiler(), "compose layers");
+            DrawLayers(layers);
+        }
+        {
+            CGE_PROFILE_ZONE(GetProfiler(), "history");
+            UpdateHistory();
         }
-                
+        {
+            CGE_PROFILE_ZONE(GetProfiler(), "save");
+            if (saveRequested)
+                Save();
+            Autosave(delta);
+        }
+        // Shows up next frame, after what was saved.
+        MoveHistory();
+
+        if (draw)
+            DrawString(0, 1 * CellHeight(), "Drawing... p0" + p0.to_string() + " p1" + p1.to_string(), COLOR_GREEN);            
+
+        if (showTiming)
+            DrawTiming();
 
-        DrawString(0, 0, L"Fps: " + std::to_wstring(1.0f / delta), COLOR_RED, true, cge::Align::Center);        
         DrawHUD();        
+        if (outputLevel != cge::OutputLevel::Normal)
+            DrawOutputWarning();
 
         return run;        
     }
+    void PasteHeatmap()
+    {
+        if (heatmap.Width() != WinWidth() / 2 || heatmap.Height() != WinHeight() / 2)
+            MakeHeatmap(WinWidth() / 2, WinHeight() / 2);
+        SetDrawTarget(layers, BACKGROUND_LAYER);
+        DrawRGB(heatmap, WinWidth() / 4, WinHeight() / 4, true);
+        edited.Add(WinWidth() / 4, WinHeight() / 4, WinWidth() / 4 + heatmap.Width() - 1, WinHeight() / 4 + heatmap.Height() - 1);
+        edits++;
+        pasteHeatmap = false;
+    }
+    // Decodes up to n rows of the loaded picture that are in the window and were not yet.
+    void LoadRows(int n)
+    {
+        cge::Layer& background = layers[BACKGROUND_LAYER];
+        loadedRows.Clear();
+        loading = loaded.Load(background.pixels, 0, WinHeight() - 1, n, &loadedRows) > 0;
+        for (const cge::DamageRect& r : loadedRows.Rects())
+            background.MarkDrawn(r.x0, r.y0, r.x1, r.y1);
+        if (!loadedRows.Empty())
+            historyStale = true;
+    }
+    // Records this frame's edits, the picture has to be composed already.
+    void UpdateHistory()
+    {
+        if (historyStale && !loading) {
+            history.Reset(Picture());
+            historyStale = false;
+        }
+        else if (!historyStale && !edited.Empty())
+            history.Commit(Picture(), edited);
+        edited.Clear();
+    }
+    void MoveHistory()
+    {
+        if (historyMoves == 0 || historyStale) {
+            historyMoves = 0;
+            return;
+        }
+        // The shapes are put into the background, which is what undo and redo restore tiles of.
+        cge::Layer& background = layers[BACKGROUND_LAYER];
+        if (canvas.Size() > 0) {
+            const cge::Framebuffer& picture = Picture();
+            for (int y = 0; y < picture.Height(); y++)
+                memcpy(background.pixels.Row(y), picture.Row(y), picture.Width() * sizeof(cge::Fragment));
+            background.MarkDrawn(0, 0, WinWidth() - 1, WinHeight() - 1);
+            canvas.Clear();
+        }
+        restored.Clear();
+        for (; historyMoves < 0 && history.Undo(background.pixels, &restored); historyMoves++) {}
+        for (; historyMoves > 0 && history.Redo(background.pixels, &restored); historyMoves--) {}
+        historyMoves = 0;
+        for (const cge::DamageRect& r : restored.Rects())
+            background.MarkDrawn(r.x0, r.y0, r.x1, r.y1);
+        if (!restored.Empty())
+            edits++;
+    }
+    // The picture is everything below the shape being drawn.
+    const cge::Framebuffer& Picture() const { return layers.Composite(CANVAS_LAYER); }
+    void Save()
+    {
+        autosave.Cancel();
+        if (cge::CanvasWriter::Save(canvasPath.empty() ? "canvas.cgec" : canvasPath, Picture()))
+            savedEdits = edits;
+        saveRequested = false;
+        sinceSave = 0.0f;
+    }
+    void Autosave(float delta)
+    {
+        sinceSave += delta;
+        if (autosave.Busy()) {
+            if (!autosave.Step(SAVE_ROWS_PER_FRAME) && !autosave.Failed())
+                savedEdits = savingEdits;
+            return;
+        }
+        if (canvasPath.empty() || loading || edits == savedEdits || sinceSave < AUTOSAVE_SECONDS)
+            return;
+        if (autosave.Begin(canvasPath, Picture()))
+            savingEdits = edits;
+        sinceSave = 0.0f;
+    }
+    // The shape being drawn, if any.
+    void DrawPreview()
+    {
+        if (!draw)
+            return;
+        if (mode == 1) {
+            if (rotate != 0.0f)
+                DrawPolyline(RectangleCorners(), RectangleTransform(), rectColor, true);
+            else
+                DrawRectangle(p0.x, p0.y, p1.x, p1.y, rectColor);
+            DrawLine(p0.x, p0.y, p1.x, p1.y, COLOR_BLUE);
+        }
+        else if (mode == 2) {
+            DrawCircle(p0.x, p0.y, (p1 - p0).Mag(), rectColor);
+            DrawLine(p0.x, p0.y, p1.x, p1.y, COLOR_BLUE);
+        }
+        else if (mode == 3) {
+            DrawLine(p0.x, p0.y, p1.x, p1.y, rectColor);
+        }
+    }
+    cge::Points2f RectangleCorners() const
+    {
+        cge::Points2f corners;
+        for (Vec2f c : { p0, Vec2f(p1.x, p0.y), p1, Vec2f(p0.x, p1.y) })
+            corners.Push(c);
+        return corners;
+    }
+    // Turns the rectangle p0, p1 around its center.
+    cge::Affine2f RectangleTransform() const
+    {
+        return cge::Affine2f::Rotation(rotate, (p0 + p1) * 0.5f);
+    }
+    // A turned rectangle goes into the canvas as its four sides, rounded like DrawPolyline() does.
+    void AddRotatedRectangle()
+    {
+        cge::Points2f corners = RectangleCorners();
+        cge::TransformPoints(RectangleTransform(), corners, corners);
+        for (size_t i = 0; i < 4; i++)
+        {
+            Vec2f a = Vec2f(corners[i].x + 0.5f, corners[i].y + 0.5f);
+            Vec2f b = Vec2f(corners[(i + 1) % 4].x + 0.5f, corners[(i + 1) % 4].y + 0.5f);
+            cge::DrawCommand side = cge::DrawCommand::Line(std::floor(a.x), std::floor(a.y), std::floor(b.x), std::floor(b.y), rectColor);
+            canvas.Add(side);
+            edited.Add(side.left, side.top, side.right, side.bottom);
+        }
+    }
+    static cge::DrawCommand ShapeCommand(Vec2f p0, Vec2f p1, int mode, uint8_t color)
+    {
+        if (mode == 1)
+            return cge::DrawCommand::Rectangle(p0.x, p0.y, p1.x, p1.y, color);
+        if (mode == 2)
+            return cge::DrawCommand::Circle(p0.x, p0.y, (p1 - p0).Mag(), color);
+        return cge::DrawCommand::Line(p0.x, p0.y, p1.x, p1.y, color);
+    }
+    void DrawTiming()
+    {
+        cge::FrameStats stats = GetFrameStats();
+        char buf[96];
+        snprintf(buf, sizeof(buf), "Fps: %.1f  avg %.2f ms  p99 %.2f ms  dropped %lu",
+            stats.avg > 0.0f ? 1000.0f / stats.avg : 0.0f, stats.avg, stats.p99, stats.dropped);
+        DrawString(WinWidth() / 2, 0, buf, COLOR_RED, true, cge::Align::Center);
+    }
+    // Tells why the picture lags behind, the terminal is not keeping up with the output.
+    void DrawOutputWarning()
+    {
+        static const char* what[] = { "", "skipping frames", "skipping frames, fewer colors", "skipping frames, fewer colors, low rate" };
+        DrawString(0, 19 * CellHeight(), string("Slow terminal: ") + what[(int)outputLevel], COLOR_YELLOW);
+    }
     void DrawHUD()
     {
+        // Positions are in characters, whatever the render mode.
+        const int cw = CellWidth(), ch = CellHeight();
         char buf[20];
         sprintf(buf, "Color: %3i [", rectColor);
-        DrawString(0, 2*2, buf, COLOR_WHITE);
-        DrawString(13, 2*2, L"███", rectColor);
-        DrawString(17, 2*2, "]", COLOR_WHITE);
-        DrawString(0, 3*2, "   Mode          Key", COLOR_WHITE);
-        DrawString(0, 4*2, "Rectangle         1", mode == 1 ? COLOR_GREEN : COLOR_WHITE, true, cge::Align::Left);
-        DrawString(0, 5*2, "Circle            2", mode == 2 ? COLOR_GREEN : COLOR_WHITE, true, cge::Align::Left);
-        DrawString(0, 6*2, "Line              3", mode == 3 ? COLOR_GREEN : COLOR_WHITE, true, cge::Align::Left);
-        DrawString(0, 8*2, "        Controls", COLOR_WHITE);
-        DrawString(0, 9*2, "'x' - exit", COLOR_WHITE);
-        DrawString(0, 10*2,"'c' - clear objects", COLOR_WHITE);
-        DrawString(0, 11*2,"'mouse wheel' - change color", COLOR_WHITE);
-        DrawString(0, 12*2,"'mouse left button' - draw", COLOR_WHITE);
+        DrawString(0, 2*ch, buf, COLOR_WHITE);
+        DrawString(13*cw, 2*ch, L"███", rectColor);
+        DrawString(17*cw, 2*ch, "]", COLOR_WHITE);
+        DrawString(0, 3*ch, "   Mode          Key", COLOR_WHITE);
+        DrawString(0, 4*ch, "Rectangle         1", mode == 1 ? COLOR_GREEN : COLOR_WHITE, true, cge::Align::Left);
+        DrawString(0, 5*ch, "Circle            2", mode == 2 ? COLOR_GREEN : COLOR_WHITE, true, cge::Align::Left);
+        DrawString(0, 6*ch, "Line              3", mode == 3 ? COLOR_GREEN : COLOR_WHITE, true, cge::Align::Left);
+        DrawString(0, 8*ch, "        Controls", COLOR_WHITE);
+        DrawString(0, 9*ch, "'x' - exit", COLOR_WHITE);
+        DrawString(0, 10*ch, "'c' - clear objects", COLOR_WHITE);
+        DrawString(0, 11*ch, "'s' - save canvas", COLOR_WHITE);
+        DrawString(0, 12*ch, "'u' / 'r' - undo / redo", COLOR_WHITE);
+        DrawString(0, 13*ch, "'q' / 'e' - turn rectangles", COLOR_WHITE);
+        DrawString(0, 14*ch, "'mouse wheel' - change color", COLOR_WHITE);
+        DrawString(0, 15*ch, "'mouse left button' - draw", COLOR_WHITE);
+        DrawString(0, 16*ch, "'p' - profiler", COLOR_WHITE);
+        DrawString(0, 17*ch, "'h' - paste heatmap", COLOR_WHITE);
     }
 };
 
-int main()
+int main(int argc, char** argv)
 {
     TestGame game;
+    cge::Backend backend = cge::Backend::Curses;
+    int headlessWidth = 0, headlessHeight = 0;
+    unsigned long frames = 0;
+    string dumpPattern;
+    int sceneShapes = 0;
+    int threads = -1;
+    string tracePath;
+    string recordPath;
+    cge::InputReplay replay;
+    bool replaying = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--ansi")
+            backend = cge::Backend::Ansi;
+        else if (arg == "--truecolor")
+            backend = cge::Backend::AnsiTrueColor;
+        else if (arg == "--headless" && i + 1 < argc)
+            sscanf(argv[++i], "%dx%d", &headlessWidth, &headlessHeight);
+        else if (arg == "--frames" && i + 1 < argc)
+            frames = std::stoul(argv[++i]);
+        else if (arg == "--dump" && i + 1 < argc)
+            dumpPattern = argv[++i];
+        else if (arg == "--scene" && i + 1 < argc)
+            sceneShapes = std::stoi(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc)
+            threads = std::stoi(argv[++i]);
+        else if (arg == "--pipelined")
+            game.SetPipelinedPresent(true);
+        else if (arg == "--input-thread")
+            game.SetInputThread(true);
+        else if (arg == "--atlas" && i + 1 < argc)
+            game.atlasPath = argv[++i];
+        else if (arg == "--canvas" && i + 1 < argc)
+            game.canvasPath = argv[++i];
+        else if (arg == "--record" && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc)
+        {
+            replaying = replay.Open(argv[++i]);
+            if (!replaying)
+                game.Errors.push_back(string("[ERROR] Not an input log: ") + argv[i]);
+        }
+        else if (arg == "--profile" && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (arg == "--mode" && i + 1 < argc)
+        {
+            string name = argv[++i];
+            if (name == "quadrant")
+                game.SetRenderMode(cge::RenderMode::Quadrant);
+            else if (name == "sextant")
+                game.SetRenderMode(cge::RenderMode::Sextant);
+            else if (name == "braille")
+                game.SetRenderMode(cge::RenderMode::Braille);
+            else
+                game.SetRenderMode(cge::RenderMode::HalfBlock);
+        }
+    }
 
-    if (game.Construct(-1, -1, -1, -1, false))
+    auto setup = [&]() {
+        game.SetDamageTracking(true);
+        game.GenerateScene(sceneShapes);
+        if (threads >= 0)
+            game.SetDeferredDrawing(true, threads);
+        game.SetProfiling(!tracePath.empty());
+        if (!recordPath.empty())
+            game.RecordInput(recordPath);
+    };
+
+    // A replay runs headless in the window it was recorded in, the checksum tells whether two builds did the same.
+    if (replaying)
+    {
+        game.SetRenderMode(replay.Header().mode);
+        headlessWidth = replay.Header().width;
+        headlessHeight = replay.Header().height;
+    }
+
+    if (headlessWidth > 0)
+    {
+        // Runs unthrottled without a terminal and prints the checksum of the last frame.
+        if (game.ConstructHeadless(headlessWidth, headlessHeight))
+        {
+            setup();
+            if (replaying)
+                game.ReplayInput(std::move(replay));
+            game.SetFrameLimit(frames ? frames : replaying ? 0 : 600);
+            game.SetFrameDump(dumpPattern);
+            game.SetFixedDelta(1.0f / 60.0f);
+            game.showTiming = false;
+            auto start = cge::Time::now();
+            game.Start();
+            std::chrono::duration<double> took = cge::Time::now() - start;
+            printf("%lu frames in %.3f s, checksum %016llx\n", game.GetFrameCount(), took.count(),
+                (unsigned long long)game.FrameChecksum());
+        }
+    }
+    else if (game.Construct(-1, -1, -1, -1, false, backend))
+    {
+        setup();
+        game.SetFrameLimit(frames);
         game.Start();
-    else
+    }
+    // The trace holds the last frames of the run.
+    if (!tracePath.empty() && !game.GetProfiler().WriteChromeTrace(tracePath))
+        game.Errors.push_back("[ERROR] Could not write the profile trace " + tracePath);
+
+    if (!game.Errors.empty())
     {
         for (string s : game.Errors) {
             fprintf(stderr, "%s\n", s.c_str());
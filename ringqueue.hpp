@@ -0,0 +1,180 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <optional>
+#include <utility>
+
+namespace cge
+{
+    namespace detail
+    {
+        constexpr size_t CACHE_LINE = 64;
+
+        inline size_t round_up_pow2(size_t n)
+        {
+            size_t p = 2;
+            while (p < n)
+                p <<= 1;
+            return p;
+        }
+    }
+
+    /*
+        Bounded lock-free queue for exactly one producer and one consumer thread.
+        Capacity is rounded up to a power of two. Elements are moved in and out.
+    */
+    template<typename T>
+    class spsc_queue
+    {
+        struct Slot { alignas(T) unsigned char storage[sizeof(T)]; };
+
+        const size_t mask;
+        std::unique_ptr<Slot[]> slots;
+        alignas(detail::CACHE_LINE) std::atomic<size_t> head{ 0 };  // next to pop, written by the consumer
+        alignas(detail::CACHE_LINE) std::atomic<size_t> tail{ 0 };  // next to push, written by the producer
+
+        T* at(size_t i) { return std::launder(reinterpret_cast<T*>(slots[i & mask].storage)); }
+
+    public:
+        explicit spsc_queue(size_t capacity)
+            : mask(detail::round_up_pow2(capacity) - 1), slots(new Slot[mask + 1]) {}
+        spsc_queue(const spsc_queue&) = delete;
+        spsc_queue& operator=(const spsc_queue&) = delete;
+        ~spsc_queue()
+        {
+            for (size_t i = head.load(); i != tail.load(); i++)
+                at(i)->~T();
+        }
+
+        size_t capacity() const { return mask + 1; }
+        size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+
+        // Returns false and leaves item untouched when the queue is full.
+        bool push(T&& item)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) > mask)
+                return false;
+            new (slots[t & mask].storage) T(std::move(item));
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+        std::optional<T> try_pop()
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire))
+                return {};
+            std::optional<T> item(std::move(*at(h)));
+            at(h)->~T();
+            head.store(h + 1, std::memory_order_release);
+            return item;
+        }
+        // Moves up to max elements into out, returns how many.
+        size_t pop_all(T* out, size_t max)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            size_t n = std::min(tail.load(std::memory_order_acquire) - h, max);
+            for (size_t i = 0; i < n; i++)
+            {
+                out[i] = std::move(*at(h + i));
+                at(h + i)->~T();
+            }
+            head.store(h + n, std::memory_order_release);
+            return n;
+        }
+    };
+
+    /*
+        Bounded lock-free queue for any number of producer threads and one
+        consumer thread. Every slot carries a sequence number telling whether it
+        is free for the lap a producer claimed or holds an element for the
+        consumer's lap.
+    */
+    template<typename T>
+    class mpsc_queue
+    {
+        struct Slot
+        {
+            std::atomic<size_t> seq;
+            alignas(T) unsigned char storage[sizeof(T)];
+        };
+
+        const size_t mask;
+        std::unique_ptr<Slot[]> slots;
+        alignas(detail::CACHE_LINE) std::atomic<size_t> tail{ 0 };  // claimed by producers
+        alignas(detail::CACHE_LINE) size_t head = 0;                // consumer only
+
+        T* at(size_t i) { return std::launder(reinterpret_cast<T*>(slots[i & mask].storage)); }
+
+    public:
+        explicit mpsc_queue(size_t capacity)
+            : mask(detail::round_up_pow2(capacity) - 1), slots(new Slot[mask + 1])
+        {
+            for (size_t i = 0; i <= mask; i++)
+                slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+        mpsc_queue(const mpsc_queue&) = delete;
+        mpsc_queue& operator=(const mpsc_queue&) = delete;
+        ~mpsc_queue()
+        {
+            while (try_pop()) {}
+        }
+
+        size_t capacity() const { return mask + 1; }
+
+        // Returns false and leaves item untouched when the queue is full.
+        bool push(T&& item)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            while (true)
+            {
+                Slot& s = slots[t & mask];
+                size_t seq = s.seq.load(std::memory_order_acquire);
+                if (seq == t) {
+                    if (tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (seq < t)
+                    return false;  // still holds the element from the previous lap
+                else
+                    t = tail.load(std::memory_order_relaxed);
+            }
+            Slot& s = slots[t & mask];
+            new (s.storage) T(std::move(item));
+            s.seq.store(t + 1, std::memory_order_release);
+            return true;
+        }
+        std::optional<T> try_pop()
+        {
+            Slot& s = slots[head & mask];
+            if (s.seq.load(std::memory_order_acquire) != head + 1)
+                return {};
+            std::optional<T> item(std::move(*at(head)));
+            at(head)->~T();
+            s.seq.store(head + mask + 1, std::memory_order_release);
+            head++;
+            return item;
+        }
+        /*
+            Moves up to max elements into out, returns how many. Stops early at an
+            element a producer has claimed but not finished writing yet.
+        */
+        size_t pop_all(T* out, size_t max)
+        {
+            size_t n = 0;
+            for (; n < max; n++, head++)
+            {
+                Slot& s = slots[head & mask];
+                if (s.seq.load(std::memory_order_acquire) != head + 1)
+                    break;
+                out[n] = std::move(*at(head));
+                at(head)->~T();
+                s.seq.store(head + mask + 1, std::memory_order_release);
+            }
+            return n;
+        }
+    };
+}
@@ -0,0 +1,123 @@
+/*
+    Draws two display lists that change every frame, with primitives drawn
+    before, between and after them, and checks that every frame comes out the
+    same with damage tracking on and off, in every render mode.
+*/
+#include <cstdio>
+#include <vector>
+#include "CursesGameEngine.hpp"
+
+static int failures = 0;
+
+class ListScene : public cge::CursesGameEngine
+{
+    unsigned seed = 7;
+    bool tracking;
+    cge::DisplayList below, above;
+    std::vector<cge::DisplayHandle> handles;
+
+    int random(int n)
+    {
+        seed = seed * 1103515245 + 12345;
+        return (int)((seed >> 8) % (unsigned)n);
+    }
+    cge::DrawCommand primitive()
+    {
+        int x = random(WinWidth()), y = random(WinHeight());
+        uint8_t color = (uint8_t)(1 + random(15));
+        switch (random(4))
+        {
+        case 0: return cge::DrawCommand::Line(x, y, x + random(30) - 15, y + random(30) - 15, color);
+        case 1: return cge::DrawCommand::Rectangle(x, y, x + random(20), y + random(20), color, true);
+        case 2: return cge::DrawCommand::Circle(x, y, random(10), color, true);
+        default: return cge::DrawCommand::Pie(x, y, random(10), 0.5f, 3.5f, color);
+        }
+    }
+    void draw_primitives(int n)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            cge::DrawCommand c = primitive();
+            switch (c.op)
+            {
+            case cge::DrawOp::Line: DrawLine(c.x0, c.y0, c.x1, c.y1, c.color); break;
+            case cge::DrawOp::FillRectangle: FillRectangle(c.x0, c.y0, c.x1, c.y1, c.color); break;
+            case cge::DrawOp::FillCircle: FillCircle(c.x0, c.y0, c.x1, c.color); break;
+            default: FillPie(c.x0, c.y0, c.x1, c.a0, c.a1, c.color); break;
+            }
+        }
+    }
+
+public:
+    ListScene(bool tracking) : tracking(tracking) {}
+
+    bool OnGameStart() override
+    {
+        SetDamageTracking(tracking);
+        return true;
+    }
+    bool OnGameUpdate(float) override
+    {
+        // Every third stretch of frames goes without Clear().
+        if ((GetFrameCount() / 40) % 3 != 2)
+            Clear(random(8) == 0 ? 3 : 0);
+        for (int i = 0; i < 2; i++)
+        {
+            int op = random(10);
+            if (op < 4)
+                handles.push_back(below.Add(primitive()));
+            else if (op < 6 && !handles.empty())
+                below.Remove(handles[random((int)handles.size())]);
+            else if (op < 8 && !handles.empty())
+                below.Modify(handles[random((int)handles.size())], primitive());
+            else if (op == 8 && random(20) == 0)
+                below.Clear();
+        }
+        if (random(3) == 0)
+            above.Add(primitive());
+        if (random(4) == 0)
+            above.Clear();
+
+        draw_primitives(random(6));
+        DrawDisplayList(below);
+        draw_primitives(random(3));
+        DrawDisplayList(above);
+        draw_primitives(random(4));
+        return true;
+    }
+};
+
+static std::vector<uint64_t> run(cge::RenderMode mode, bool tracking)
+{
+    ListScene scene(tracking);
+    scene.SetRenderMode(mode);
+    scene.ConstructHeadless(97, 61);
+    scene.SetFrameLimit(300);
+    scene.SetFixedDelta(1 / 60.0f);
+    scene.Start();
+    return scene.FrameChecksums();
+}
+
+int main()
+{
+    const cge::RenderMode modes[] = { cge::RenderMode::HalfBlock, cge::RenderMode::Quadrant,
+        cge::RenderMode::Sextant, cge::RenderMode::Braille };
+    for (cge::RenderMode mode : modes)
+    {
+        std::vector<uint64_t> off = run(mode, false), on = run(mode, true);
+        if (off.size() != on.size() || off.empty()) {
+            fprintf(stderr, "render mode %d: %zu frames without tracking, %zu with\n", (int)mode, off.size(), on.size());
+            failures++;
+            continue;
+        }
+        for (size_t i = 0; i < off.size(); i++)
+            if (off[i] != on[i]) {
+                fprintf(stderr, "render mode %d: frame %zu differs with damage tracking\n", (int)mode, i);
+                failures++;
+                break;
+            }
+    }
+    if (failures)
+        fprintf(stderr, "%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+/*
+    Fills a TextArena to capacity, from one thread and from several, and checks
+    that only the strings that did not fit are dropped and that Reset() makes
+    room for them.
+*/
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "TextArena.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static void fill_to_capacity()
+{
+    cge::TextArena arena(64, 64);
+    uint32_t offset;
+    for (int i = 0; i < 8; i++)
+    {
+        wchar_t* p = arena.Allocate(8, offset);
+        CHECK(p != NULL);
+        CHECK(offset == (uint32_t)i * 8);
+        if (p)
+            std::fill_n(p, 8, (wchar_t)('a' + i));
+    }
+    CHECK(arena.Used() == arena.Capacity());
+    // Full, even a single character is dropped, and the strings before stay intact.
+    CHECK(arena.Allocate(1, offset) == NULL);
+    CHECK(arena.Used() == 64);
+    cge::TextRun run{ 56, 8, 0, 0, false, 0 };
+    CHECK(arena.Chars(run)[0] == L'h' && arena.Chars(run)[7] == L'h');
+
+    arena.Reset();
+    CHECK(arena.Capacity() >= 65);
+    CHECK(arena.Used() == 0);
+}
+
+static void drops_only_what_does_not_fit()
+{
+    cge::TextArena arena(64, 64);
+    uint32_t offset;
+    CHECK(arena.Allocate(40, offset) != NULL);
+    // Too long for the 24 characters left, but shorter strings after it still fit.
+    CHECK(arena.Allocate(30, offset) == NULL);
+    CHECK(arena.Allocate(20, offset) != NULL && offset == 40);
+    CHECK(arena.Allocate(4, offset) != NULL && offset == 60);
+    CHECK(arena.Allocate(1, offset) == NULL);
+
+    // The next frame has room for everything this frame asked for.
+    arena.Reset();
+    CHECK(arena.Capacity() >= 40 + 30 + 20 + 4 + 1);
+    CHECK(arena.Allocate(40, offset) != NULL);
+    CHECK(arena.Allocate(30, offset) != NULL);
+    CHECK(arena.Allocate(20, offset) != NULL);
+    CHECK(arena.Allocate(4, offset) != NULL);
+    CHECK(arena.Allocate(1, offset) != NULL);
+}
+
+static void fill_from_threads()
+{
+    const int THREADS = 4, PER_THREAD = 1000, LENGTH = 3;
+    cge::TextArena arena(4096, 8192);
+    std::vector<int> fitted(THREADS, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++)
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < PER_THREAD; i++)
+            {
+                uint32_t offset;
+                wchar_t* p = arena.Allocate(LENGTH, offset);
+                if (!p)
+                    continue;
+                std::fill_n(p, LENGTH, (wchar_t)('0' + t));
+                fitted[t]++;
+                arena.Submit(cge::TextRun{ offset, (uint32_t)LENGTH, t, 0, false, 0 });
+            }
+        });
+    for (std::thread& t : threads)
+        t.join();
+
+    int total = 0;
+    for (int n : fitted)
+        total += n;
+    // Every allocation that fits gets made, the arena ends up as full as it can be.
+    CHECK(total == 4096 / LENGTH);
+    CHECK(arena.Used() == (size_t)total * LENGTH);
+
+    // Every queued run still holds the characters of the thread that wrote it.
+    cge::TextRun runs[256];
+    size_t n, drained = 0;
+    while ((n = arena.Drain(runs, 256)) > 0)
+        for (size_t i = 0; i < n; i++, drained++)
+        {
+            const wchar_t* chars = arena.Chars(runs[i]);
+            for (int k = 0; k < LENGTH; k++)
+                CHECK(chars[k] == (wchar_t)('0' + runs[i].x));
+        }
+    CHECK(drained == (size_t)total);
+
+    arena.Reset();
+    CHECK(arena.Capacity() >= (size_t)THREADS * PER_THREAD * LENGTH);
+}
+
+int main()
+{
+    fill_to_capacity();
+    drops_only_what_does_not_fit();
+    fill_from_threads();
+    if (failures)
+        fprintf(stderr, "%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,89 @@
+/*
+    Draws an RGB picture and sends the frame through AnsiBackend into a pipe,
+    then checks that with true color the terminal gets the original colors and
+    without it the nearest of the 256 colors.
+*/
+#include <cstdio>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include "CursesGameEngine.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static const uint32_t TOP = cge::PackRGB(17, 34, 51), BOTTOM = cge::PackRGB(200, 100, 50);
+
+class RGBScene : public cge::CursesGameEngine
+{
+    cge::RGBFramebuffer picture;
+
+public:
+    bool OnGameStart() override
+    {
+        // Every cell gets TOP as background and BOTTOM as foreground.
+        picture.Resize(WinWidth(), WinHeight());
+        for (int y = 0; y < WinHeight(); y++)
+            picture.FillSpan(0, WinWidth(), y, y % 2 ? BOTTOM : TOP);
+        return true;
+    }
+    bool OnGameUpdate(float) override
+    {
+        Clear(0);
+        DrawRGB(picture, 0, 0);
+        return true;
+    }
+};
+
+// Everything the backend wrote for one frame.
+static std::string present(bool trueColor)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return "";
+    RGBScene scene;
+    scene.ConstructHeadless(8, 4);
+    scene.SetOutputBackend(std::make_unique<cge::AnsiBackend>(fds[1], 0, 0, 1000, trueColor));
+    scene.SetFrameLimit(1);
+    scene.Start();
+
+    std::string out;
+    char buf[4096];
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0)
+        out.append(buf, (size_t)n);
+    close(fds[0]);
+    close(fds[1]);
+    return out;
+}
+
+static bool contains(const std::string& s, const std::string& part)
+{
+    return s.find(part) != std::string::npos;
+}
+
+int main()
+{
+    std::string rgb = present(true);
+    CHECK(contains(rgb, "38;2;200;100;50"));
+    CHECK(contains(rgb, "48;2;17;34;51"));
+    CHECK(!contains(rgb, "38;5;"));
+
+    const cge::QuantizeLUT& lut = cge::QuantizeLUT::For(256);
+    std::string palette = present(false);
+    CHECK(contains(palette, "38;5;" + std::to_string(lut.Nearest(BOTTOM))));
+    CHECK(contains(palette, "48;5;" + std::to_string(lut.Nearest(TOP))));
+    CHECK(!contains(palette, "38;2;"));
+
+    if (failures)
+        fprintf(stderr, "%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}